@@ -1,4 +1,5 @@
 #include <genieArduino.h>
+#include "genieProject.h"  // Generated from genieArduino-WS4-Demo.4DGenie by tools/genieProjectGen.py
 
 // Updated version of the genieArduino library and Demo
 // 4D Systems
@@ -11,7 +12,7 @@
 void setup() 
 { 
   // a few options to talk to the Display, uncomment the one you want
-  genieBegin (GENIE_SERIAL, 115200);  //Serial0
+  genieBegin (GENIE_SERIAL, GENIE_PROJECT_SPEED);  //Serial0, at the speed set in the project
   //genieBegin (GENIE_SERIAL_1, 9600);  //Serial1
   //genieBegin (GENIE_SERIAL_2, 9600);  //Serial2
   //genieBegin (GENIE_SERIAL_3, 9600);  //Serial3
@@ -44,14 +45,14 @@ void loop()
   if (millis() >= waitPeriod) 
   {
     // Write to CoolGauge0 with the value in the gaugeVal variable
-    genieWriteObject(GENIE_OBJ_COOL_GAUGE, 0x00, gaugeVal); 
+    genieWriteObject(Form0::Coolgauge0, gaugeVal); 
     gaugeVal += gaugeAddVal;
     if (gaugeVal == 99) gaugeAddVal = -1;
     if (gaugeVal == 0) gaugeAddVal = 1;
 
     // The results of this call will be available to myGenieEventHandler() after the display has responded
     // Do a manual read from the Slider0 object
-    genieReadObject(GENIE_OBJ_SLIDER, 0x00);
+    genieReadObject(Form0::Slider0);
 
     waitPeriod = millis() + 100;
   }
@@ -90,44 +91,51 @@ void myGenieEventHandler(void)
 }*/
 
 //LONG HAND VERSION, MAYBE MORE VISIBLE AND MORE LIKE VERSION 1 OF THE LIBRARY
+//The events are read in place from the library's queue with geniePeekEvents()
+//and released in one go with genieConsumeEvents(), so no copy is needed
 void myGenieEventHandler(void) 
 {
-  genieFrame Event;
-  genieDequeueEvent(&Event);
+  uint8_t count;
+  const genieFrame * Event = geniePeekEvents(&count);
 
   int slider_val = 0;
 
-  //If the cmd received is from a Reported Event
-  if(Event.reportObject.cmd == GENIE_REPORT_EVENT)
+  for (uint8_t i = 0; i < count; i++, Event++)
   {
-    if (Event.reportObject.object == GENIE_OBJ_SLIDER)                // If the Reported Message was from a Slider
+    //If the cmd received is from a Reported Event
+    if(Event->reportObject.cmd == GENIE_REPORT_EVENT)
     {
-      if (Event.reportObject.index == 0)                              // If Slider0
+      if (Event->reportObject.object == GENIE_OBJ_SLIDER)                // If the Reported Message was from a Slider
       {
-        slider_val = (Event.reportObject.data_msb << 8) + Event.reportObject.data_lsb;  // Slider0 data into the slider_val setpoint  
-        genieWriteObject(GENIE_OBJ_LED_DIGITS, 0x00, slider_val);     // Write Slider0 value to to LED Digits 0
+        if (Event->reportObject.index == 0)                              // If Slider0
+        {
+          slider_val = (Event->reportObject.data_msb << 8) + Event->reportObject.data_lsb;  // Slider0 data into the slider_val setpoint  
+          genieWriteObject(GENIE_OBJ_LED_DIGITS, 0x00, slider_val);     // Write Slider0 value to to LED Digits 0
+        }
       }
     }
-  }
 
-  //If the cmd received is from a Reported Object, which occurs if a Read Object is requested in the main code, reply processed here.
-  if(Event.reportObject.cmd == GENIE_REPORT_OBJ)
-  {
-    if (Event.reportObject.object == GENIE_OBJ_SLIDER)                // If the Reported Message was from a Slider
+    //If the cmd received is from a Reported Object, which occurs if a Read Object is requested in the main code, reply processed here.
+    if(Event->reportObject.cmd == GENIE_REPORT_OBJ)
     {
-      if (Event.reportObject.index == 0)                              // If Slider0
+      if (Event->reportObject.object == GENIE_OBJ_SLIDER)                // If the Reported Message was from a Slider
       {
-        slider_val = (Event.reportObject.data_msb << 8) + Event.reportObject.data_lsb;  // Slider0 data into the slider_val setpoint  
-        genieWriteObject(GENIE_OBJ_LED_DIGITS, 0x00, slider_val);     // Write Slider0 value to to LED Digits 0
+        if (Event->reportObject.index == 0)                              // If Slider0
+        {
+          slider_val = (Event->reportObject.data_msb << 8) + Event->reportObject.data_lsb;  // Slider0 data into the slider_val setpoint  
+          genieWriteObject(GENIE_OBJ_LED_DIGITS, 0x00, slider_val);     // Write Slider0 value to to LED Digits 0
+        }
       }
     }
   }
 
+  genieConsumeEvents(count);  // Release all the frames handled above
+
   //This can be expanded as more objects are added that need to be captured
 
-  //Event.reportObject.cmd is used to determine the command of that event, such as an reported event
-  //Event.reportObject.object is used to determine the object type, such as a Slider
-  //Event.reportObject.index is used to determine the index of the object, such as Slider0
-  //Event.reportObject.data_msb and _lsb are used to save the data to a variable. They are in bytes, need to be combined to save as integer.
+  //Event->reportObject.cmd is used to determine the command of that event, such as an reported event
+  //Event->reportObject.object is used to determine the object type, such as a Slider
+  //Event->reportObject.index is used to determine the index of the object, such as Slider0
+  //Event->reportObject.data_msb and _lsb are used to save the data to a variable. They are in bytes, need to be combined to save as integer.
 }
 
@@ -0,0 +1,39 @@
+/////////////////////// Generated by genieProjectGen.py ///////////////////////
+//
+//      From genieArduino-WS4-Demo.4DGenie, do not edit.
+//      Object handles, counts and link settings for genieArduino.
+//
+
+#ifndef genieProject_h
+#define genieProject_h
+
+#include "genieArduino.h"
+
+// Link settings from the project Options
+
+#define	GENIE_PROJECT_SPEED			115200
+#define	GENIE_PROJECT_SNDBUF		2
+#define	GENIE_PROJECT_MULTIDROP		0
+#define	GENIE_PROJECT_DESTINATION	1
+
+// Object counts, forms are not included in GENIE_PROJECT_OBJECTS
+
+#define	GENIE_PROJECT_FORMS			1
+#define	GENIE_PROJECT_OBJECTS		4
+#define	GENIE_PROJECT_COOL_GAUGE	1
+#define	GENIE_PROJECT_LED_DIGITS	1
+#define	GENIE_PROJECT_SLIDER	1
+#define	GENIE_PROJECT_STRINGS	1
+
+namespace Form0 {
+	constexpr genieObjectHandle	handle = { GENIE_OBJ_FORM, 0, 0 };
+	constexpr genieObjectHandle	Leddigits0 = { GENIE_OBJ_LED_DIGITS, 0, 0 };
+	constexpr genieObjectHandle	Coolgauge0 = { GENIE_OBJ_COOL_GAUGE, 0, 0 };
+	constexpr genieObjectHandle	Slider0 = { GENIE_OBJ_SLIDER, 0, 0 };
+	constexpr genieObjectHandle	Strings0 = { GENIE_OBJ_STRINGS, 0, 0 };
+
+	constexpr uint8_t			objectCount = 4;
+	constexpr genieObjectHandle	objects[] = { Leddigits0, Coolgauge0, Slider0, Strings0 };
+}
+
+#endif
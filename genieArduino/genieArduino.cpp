@@ -28,6 +28,8 @@
  *********************************************************************/
 
 #include "genieArduino.h"
+#include <limits.h>
+#include <stdarg.h>
 
 ////////////////////////////////////////////////////////////
 // Functions not available to the user code
@@ -36,19 +38,60 @@ void		_geniePutchar_Serial	(uint8_t c, uint32_t baud);
 void		_geniePutchar_Serial1 	(uint8_t c, uint32_t baud);
 void		_geniePutchar_Serial2 	(uint8_t c, uint32_t baud);
 void		_geniePutchar_Serial3 	(uint8_t c, uint32_t baud);
-void		_geniePutchar_SerialUSB (uint8_t c, uint32_t baud);
+void		_geniePutchar_Stream	(uint8_t c, uint32_t baud);
 uint16_t	_genieGetchar_Serial	(void);
 uint16_t	_genieGetchar_Serial1	(void);
 uint16_t	_genieGetchar_Serial2	(void);
 uint16_t	_genieGetchar_Serial3	(void);
-uint16_t	_genieGetchar_SerialUSB	(void);
+uint16_t	_genieGetchar_Stream	(void);
+#ifndef GENIE_WRITE_ONLY
 void		_genieFlushEventQueue	(void);
+#endif
 void		_handleError			(void);
 void		_geniePutchar			(uint8_t c);
+void		_genieWrite				(const uint8_t * buf, uint8_t len);
 uint8_t		_genieGetchar			(void);
+uint8_t		_genieRxStream			(void);
+void		_genieStartLink			(void);
 void		_genieSetLinkState		(uint16_t newstate);
 uint16_t	_genieGetLinkState		(void);	
+#ifndef GENIE_WRITE_ONLY
 bool		_genieEnqueueEvent		(uint8_t * data);
+bool		_genieSendRead			(uint8_t object, uint8_t index);
+#endif
+#ifdef GENIE_EVENT_TIMESTAMPS
+void		_genieRecordLatency		(genieLatencyStruct * l, uint32_t us);
+void		_genieRecordDispatch	(void);
+#endif
+#if MAX_GENIE_FILTERS > 0
+bool		_genieFilterEvent		(uint8_t * data);
+#endif
+#if MAX_GENIE_CACHE > 0
+void		_genieCacheUpdate		(uint8_t * data);
+void		_genieFlushCache		(void);
+#endif
+void		_genieWaitForIdle		(void);
+void		_genieFatalError		(uint8_t d);
+void		_genieLinkAlive			(uint8_t d);
+#ifndef GENIE_NO_LINK_MONITOR
+void		_genieLinkMonitor		(void);
+bool		_genieNextProbe			(bool down, uint8_t * d);
+#endif
+void		_genieResetLinkState	(void);
+void		_genieSendWriteObj		(uint8_t object, uint8_t index, uint16_t data);
+#ifndef GENIE_NO_STRINGS
+void		_genieSendStr			(uint8_t code, uint8_t index, const char * string, uint8_t len);
+#endif
+bool		_genieWaitForLink		(uint8_t newstate);
+bool		_genieLinkIdle			(void);
+#ifdef GENIE_QUEUE_STATS
+void		_genieQueueLevel		(genieQueueStatsStruct * stats, uint8_t level);
+#endif
+#ifdef GENIE_MULTIDROP
+uint8_t		_genieFindDisplay		(uint8_t address);
+void		_genieSendAddress		(uint8_t d);
+void		_genieNextEventDisplay	(void);
+#endif
 
 #if (ARDUINO >= 100)
 # include "Arduino.h" // for Arduino 1.0
@@ -56,11 +99,95 @@ bool		_genieEnqueueEvent		(uint8_t * data);
 # include "WProgram.h" // for Arduino 23
 #endif
 
+//////////////////////////////////////////////////////////////
+// With GENIE_RX_INTERRUPT defined, characters are received in 
+// an interrupt so anything it shares with the main code is 
+// protected by disabling interrupts. These are only used from 
+// the main code, never from genieRxByte().
+//
+#ifdef GENIE_RX_INTERRUPT
+#define	GENIE_LOCK()		noInterrupts()
+#define	GENIE_UNLOCK()		interrupts()
+#else
+#define	GENIE_LOCK()
+#define	GENIE_UNLOCK()
+#endif
+
+//////////////////////////////////////////////////////////////
+// Parts compiled out by the build profile are replaced by 
+// these so the code that calls them needn't be conditional.
+//
+#ifdef GENIE_WRITE_ONLY
+#define	_genieEnqueueEvent(d)	((void)0)
+#define	_genieFlushEventQueue()
+#endif
+#if MAX_GENIE_FILTERS == 0
+#define	_genieFilterEvent(d)	TRUE
+#endif
+#if MAX_GENIE_CACHE == 0
+#define	_genieCacheUpdate(d)
+#define	_genieFlushCache()
+#endif
+#ifdef GENIE_NO_LINK_MONITOR
+#define	_genieLinkMonitor()
+#endif
+#ifndef GENIE_MULTIDROP
+#define	_genieTxDisplay		0
+#define	_genieRxDisplay		0
+#define	_genieLinkDisplay	0
+#define	_genieNumDisplays	1
+#endif
+
+#ifdef GENIE_MULTIDROP
+//////////////////////////////////////////////////////////////
+// The displays on the bus. Displays are numbered by their 
+// position in the table, the number is used everywhere except 
+// on the bus and in the user API.
+//
+static uint8_t	_genieDisplayAddrs[MAX_GENIE_DISPLAYS];
+static uint8_t	_genieNumDisplays = 0;
+static genieDisplayStatsStruct _genieDisplayStats[MAX_GENIE_DISPLAYS];
+static uint8_t	_genieTxDisplay = 0;		// commands are sent to
+static uint8_t	_genieLinkDisplay = 0;		// the command awaiting a reply went to
+static uint8_t	_genieRxDisplay = GENIE_NO_DISPLAY;	// the transmission being received is from
+static bool		_genieRxAddressed = FALSE;	// its address has been received
+#ifndef GENIE_WRITE_ONLY
+static uint8_t	_genieEventDisplay = 0;		// the user's handler is reading events from
+#endif
+#endif
+
 //////////////////////////////////////////////////////////////
 // A structure to hold up to MAX_GENIE_EVENTS events receive
-// from the display
+// from the display, one per display with GENIE_MULTIDROP.
+// _genieEventQueue is the one the user's functions read.
+//
+#ifndef GENIE_WRITE_ONLY
+#ifdef GENIE_MULTIDROP
+static genieEventQueueStruct _genieEventQueues[MAX_GENIE_DISPLAYS];
+#define	_genieEventQueue	_genieEventQueues[_genieEventDisplay]
+#else
+static genieEventQueueStruct _genieEventQueues[1];
+#define	_genieEventQueue	_genieEventQueues[0]
+#endif
+#endif
+
+//////////////////////////////////////////////////////////////
+// Table of filters applied to received frames before they
+// are queued, and what to do with frames no filter matches
+//
+#if MAX_GENIE_FILTERS > 0
+static genieEventFilterStruct _genieEventFilters[MAX_GENIE_FILTERS];
+static uint8_t	_genieNumFilters = 0;
+static uint8_t	_genieFilterDefault = GENIE_FILTER_ALLOW;
+static uint16_t	_genieFilterDefaultDrops = 0;
+#endif
+
+//////////////////////////////////////////////////////////////
+// The last value reported for a number of objects
 //
-static genieEventQueueStruct _genieEventQueue;
+#if MAX_GENIE_CACHE > 0
+static genieCacheEntryStruct _genieCache[MAX_GENIE_CACHE];
+#endif
 
 //////////////////////////////////////////////////////////////
 // Simple 5-deep stack for the link state, this allows 
@@ -86,12 +213,93 @@ static int _genieTimeouts = 0;
 // Global error variable
 static int _genieError = ERROR_NONE;
 
+//////////////////////////////////////////////////////////////
+// How the display answered the last command, ERROR_NONE for an
+// ACK, ERROR_NAK or ERROR_TIMEOUT
+static int _genieReplyError = ERROR_NONE;
+
 
 static uint8_t	rxframe_count = 0;
 
+#ifdef GENIE_EVENT_TIMESTAMPS
+//////////////////////////////////////////////////////////////
+// When the first byte of the frame being received arrived, and
+// how long frames have waited for the handler and in the queue
+static uint32_t	_genieRxStamp = 0;
+static genieLatencyStruct _genieDispatchLatency;
+static genieLatencyStruct _genieResidenceLatency;
+#endif
+
+#ifdef GENIE_QUEUE_STATS
+//////////////////////////////////////////////////////////////
+// Queues holding more than this many entries are counted as 
+// being above the threshold
+static uint8_t	_genieQueueThreshold = GENIE_QUEUE_THRESHOLD;
+#endif
+
+#ifdef GENIE_RX_INTERRUPT
+//////////////////////////////////////////////////////////////
+// Characters received by genieRxByte(), so genieDoEvents() can
+// tell when something is being received, and the longest time
+// genieRxInterrupt() has spent on one character
+static uint16_t	_genieRxCount = 0;
+static uint32_t	_genieRxMaxTime = 0;
+#endif
+
+//////////////////////////////////////////////////////////////
+// Number of consecutive fatal errors encountered, and the 
+// number that will cause the display to be declared down
+#ifndef GENIE_NO_LINK_MONITOR
+static int _genieMaxFatals = MAX_GENIE_FATALS;
+#endif
+
+//////////////////////////////////////////////////////////////
+// Link health monitor. While a display is down commands to it 
+// fail immediately and it is probed every _genieProbePeriod mS, 
+// while it is up and the link has been quiet for 
+// _genieHeartbeatPeriod mS a heartbeat read is sent to check it 
+// is still there. With GENIE_MULTIDROP each display has its own 
+// failure count and down state, kept with its stats, so one that
+// has gone doesn't take the others with it.
+//
+#ifdef GENIE_MULTIDROP
+#define	_genieFatals(d)		(_genieDisplayStats[d].fatals)
+#define	_genieDown(d)		(_genieDisplayStats[d].down)
+#else
+static int		_genieFatalErrors = 0;
+static bool		_genieDisplayDown = FALSE;
+#define	_genieFatals(d)		_genieFatalErrors
+#define	_genieDown(d)		_genieDisplayDown
+#endif
+static bool		_genieRestorePending = FALSE;
+static uint32_t	_genieLastActivity = 0;
+#ifndef GENIE_NO_LINK_MONITOR
+static bool		_genieProbePending = FALSE;
+static uint32_t	_genieProbeSent = 0;
+static uint8_t	_genieProbeDisplay = 0;		// the display last probed
+static uint16_t	_genieHeartbeatPeriod = HEARTBEAT_PERIOD;
+static uint16_t	_genieProbePeriod = PROBE_PERIOD;
+#endif
+
+//////////////////////////////////////////////////////////////
+// Mirror of what has been written to the display, replayed
+// when the display restarts
+//
+#if MAX_GENIE_MIRROR > 0
+static genieMirrorEntryStruct _genieMirror[MAX_GENIE_MIRROR];
+static uint8_t	_genieMirrorCount = 0;
+#endif
+#if MAX_GENIE_MIRROR_STRS > 0
+static genieMirrorStrStruct _genieMirrorStrs[MAX_GENIE_MIRROR_STRS];
+#endif
+static uint8_t	_genieCurrentForm = 0;
+static int16_t	_genieContrast = -1;		// -1 if never written
+
 //////////////////////////////////////////////////////////////
-// Number of fatal errors encountered
-static int _genieFatalErrors = 0;
+// Number of ACKs still expected in the GENIE_LINK_WFAN state,
+// more than one after a burst of commands
+//
+static uint16_t	_genieAcksPending = 0;
 
 //////////////////////////////////////////////////////////////
 // Pointers to the current serial Tx and Rx functions.
@@ -99,21 +307,51 @@ static int _genieFatalErrors = 0;
 static geniePutCharFuncPtr _geniePutCharHandler = NULL;
 static genieGetCharFuncPtr _genieGetCharHandler = NULL;
 
+//////////////////////////////////////////////////////////////
+// The Stream passed to genieBegin(), NULL when one of the 
+// serial ports is used through the handler tables
+//
+static Stream * _genieStream = NULL;
+
 //////////////////////////////////////////////////////////////
 // Pointer to the user's event handler function
 //
+#ifndef GENIE_WRITE_ONLY
 static genieUserEventHandlerPtr _genieUserHandler = NULL;
 
+//////////////////////////////////////////////////////////////
+// TRUE while the user's handler is running, it is not re-entered
+// and the event queue is not flushed under it
+//
+static bool		_genieInHandler = FALSE;
+#endif
+
 //////////////////////////////////////////////////////////////
 //	Array of pointers to functions that send a byte to the 
 // 	module via the various serial ports
 //
 static geniePutCharFuncPtr _geniePutCharFuncTable[] = {
   NULL,
+#ifdef SERIAL
   _geniePutchar_Serial,
+#else
+  NULL,
+#endif
+#ifdef SERIAL_1
   _geniePutchar_Serial1,
+#else
+  NULL,
+#endif
+#ifdef SERIAL_2
   _geniePutchar_Serial2,
+#else
+  NULL,
+#endif
+#ifdef SERIAL_3
   _geniePutchar_Serial3
+#else
+  NULL
+#endif
 };
 
 //////////////////////////////////////////////////////////////
@@ -122,12 +360,29 @@ static geniePutCharFuncPtr _geniePutCharFuncTable[] = {
 //
 static genieGetCharFuncPtr _genieGetCharFuncTable[] = {
   NULL,
+#ifdef SERIAL
   _genieGetchar_Serial,
+#else
+  NULL,
+#endif
+#ifdef SERIAL_1
   _genieGetchar_Serial1,
+#else
+  NULL,
+#endif
+#ifdef SERIAL_2
   _genieGetchar_Serial2,
+#else
+  NULL,
+#endif
+#ifdef SERIAL_3
   _genieGetchar_Serial3
+#else
+  NULL
+#endif
 };
 
+#ifndef GENIE_WRITE_ONLY
 ////////////////////// genieGetEventData ////////////////////////
 //
 // Returns the LSB and MSB of the event's data combined into
@@ -157,6 +412,24 @@ bool genieEventIs(genieFrame * e, uint8_t cmd, uint8_t object, uint8_t index) {
 
 }
 
+////////////////////// genieObjectHandle versions //////////////
+//
+// Forms of genieEventIs(), genieReadObject() and genieWriteObject()
+// that take an object handle generated from the project file.
+//
+bool genieEventIs(genieFrame * e, uint8_t cmd, genieObjectHandle h) {
+	return genieEventIs(e, cmd, h.object, h.index);
+}
+
+bool genieReadObject (genieObjectHandle h) {
+	return genieReadObject(h.object, h.index);
+}
+#endif
+
+uint16_t genieWriteObject (genieObjectHandle h, uint16_t data) {
+	return genieWriteObject(h.object, h.index, data);
+}
+
 ////////////////////// _genieWaitForIdle ////////////////////////
 //
 // Wait for the link to become idle or for the timeout period, 
@@ -176,12 +449,20 @@ void _genieWaitForIdle (void) {
 			timeout = millis() + _genieTimeout;
 		}
 		
-		if (_genieGetLinkState() == GENIE_LINK_IDLE) {
+		if (_genieLinkIdle()) {
 			return;
 		}
 	}
 	_genieError = ERROR_TIMEOUT;
+	_genieReplyError = ERROR_TIMEOUT;
 	_handleError();
+#ifdef GENIE_MULTIDROP
+	_genieDisplayStats[_genieLinkDisplay].timeouts++;
+#endif
+
+	// give up on whatever we were waiting for
+	_genieResetLinkState();
+	_genieFatalError(_genieLinkDisplay);
 	return;
 }
 
@@ -191,11 +472,93 @@ void _genieWaitForIdle (void) {
 //
 void _geniePushLinkState (uint8_t newstate) {
 
+	_genieLastActivity = millis();
 	_genieLinkState++;
 	_genieSetLinkState(newstate);
 
 }
 
+////////////////////// _genieWaitForLink ////////////////////////
+//
+// Wait for the link to become idle before sending a command, then
+// set the link state the command will leave it in. Returns at once
+// if the selected display is down. With GENIE_MULTIDROP the address
+// of the selected display is sent ahead of the command.
+//
+// Parms:	uint8_t newstate, GENIE_LINK_WFAN or GENIE_LINK_WF_RXREPORT
+//
+// Returns:	TRUE if the command can be sent
+//			FALSE if the display is down
+// Sets:	ERROR_NODISPLAY if the display is down
+//
+bool _genieWaitForLink (uint8_t newstate) {
+	bool claimed = FALSE;
+
+#ifdef GENIE_MULTIDROP
+	if (_genieNumDisplays == 0) {
+		_genieError = ERROR_NODISPLAY;
+		return FALSE;
+	}
+#endif
+
+	while (!_genieDown(_genieTxDisplay)) {
+		_genieWaitForIdle();
+
+		// Take the link before sending so a reply received in the 
+		// background can't arrive first. If a frame from the display
+		// started in the meantime go back and wait for it.
+		GENIE_LOCK();
+		if (!_genieDown(_genieTxDisplay) && _genieGetLinkState() == GENIE_LINK_IDLE) {
+			_geniePushLinkState(newstate);
+			claimed = TRUE;
+		}
+		GENIE_UNLOCK();
+
+		if (claimed) {
+#ifdef GENIE_MULTIDROP
+			_genieSendAddress(_genieTxDisplay);
+#endif
+			return TRUE;
+		}
+	}
+
+	_genieError = ERROR_NODISPLAY;
+	return FALSE;
+}
+
+////////////////////// _genieLinkIdle ///////////////////////////
+//
+// Returns:	TRUE if the link is idle, for use by the main code
+//
+bool _genieLinkIdle (void) {
+	bool idle;
+
+	GENIE_LOCK();
+	idle = (_genieGetLinkState() == GENIE_LINK_IDLE);
+	GENIE_UNLOCK();
+	return idle;
+}
+
+////////////////////// _genieResetLinkState /////////////////////
+//
+// Empty the link state stack and return to the idle state,
+// abandoning any frame being received
+//
+void _genieResetLinkState (void) {
+	GENIE_LOCK();
+	_genieLinkState = &_genieLinkStates[0];
+	_genieSetLinkState(GENIE_LINK_IDLE);
+	rxframe_count = 0;
+#ifdef GENIE_MULTIDROP
+	_genieRxAddressed = FALSE;
+#endif
+#ifndef GENIE_NO_LINK_MONITOR
+	_genieProbePending = FALSE;
+#endif
+	_genieAcksPending = 0;
+	GENIE_UNLOCK();
+}
+
 ////////////////////// _geniePopLinkState //////////////////////
 //
 // Pop a link state from a FILO stack
@@ -211,22 +574,100 @@ void _geniePopLinkState (void) {
 //
 // This is the heart of the Genie comms state machine.
 //
+// Normally it reads a character from the display and passes it to
+// genieRxByte(), or everything waiting if the link is a Stream. 
+// With GENIE_RX_INTERRUPT defined the characters are
+// received in the background by genieRxInterrupt() and this just 
+// calls the user's handler.
+//
 uint16_t genieDoEvents (void) {
+#ifdef GENIE_RX_INTERRUPT
+	static uint16_t	last_rx_count = 0;
+	uint16_t		rx_count;
+
+	GENIE_LOCK();
+	rx_count = _genieRxCount;
+	GENIE_UNLOCK();
+
+	// tell _genieWaitForIdle() something is being received
+	if (rx_count != last_rx_count) {
+		last_rx_count = rx_count;
+		return GENIE_EVENT_RXCHAR;
+	}
+#else
 	uint8_t c;
-	static uint8_t	rx_data[6];
-	static uint8_t	checksum = 0;
 
-	c = _genieGetchar();
+	if (_genieStream != NULL) {
+		if (_genieRxStream() > 0)
+			return GENIE_EVENT_RXCHAR;
+	} else {
+		c = _genieGetchar();
+
+		if (_genieError != ERROR_NOCHAR)
+			return genieRxByte(c);
+	}
+#endif
 
 	////////////////////////////////////////////
 	//
 	// If there are no characters to process and we have 
 	// queued events call the user's handler function.
+	// The handler is not re-entered if it writes to the display,
+	// that lets it process frames in place via geniePeekEvents()
+	// without them being handled a second time.
 	//
-	if (_genieError == ERROR_NOCHAR) {
-		if (_genieEventQueue.n_events > 0) (_genieUserHandler)();
-		return GENIE_EVENT_NONE;
+	_genieLinkMonitor();
+#ifndef GENIE_WRITE_ONLY
+#ifdef GENIE_MULTIDROP
+	if (!_genieInHandler)
+		_genieNextEventDisplay();
+#endif
+	if (_genieEventQueue.n_events > 0 && !_genieInHandler) {
+#ifdef GENIE_EVENT_TIMESTAMPS
+		_genieRecordDispatch();
+#endif
+		_genieInHandler = TRUE;
+		(_genieUserHandler)();
+		_genieInHandler = FALSE;
+	}
+#endif
+	return GENIE_EVENT_NONE;
+}
+
+///////////////////////// genieRxByte ///////////////////////////
+//
+// Process one character received from the display. Complete
+// frames are queued for the user's handler, ACKs and NAKs update
+// the link state.
+//
+// With GENIE_RX_INTERRUPT defined this is called with interrupts
+// disabled, either from genieRxInterrupt() or directly from the 
+// user's own UART receive interrupt.
+//
+// Returns:	GENIE_EVENT_RXCHAR
+//
+uint16_t genieRxByte (uint8_t c) {
+	static uint8_t	rx_data[GENIE_FRAME_SIZE];
+	static uint8_t	checksum = 0;
+
+#ifdef GENIE_RX_INTERRUPT
+	_genieRxCount++;
+#endif
+	_genieLastActivity = millis();
+
+#ifdef GENIE_MULTIDROP
+	// every transmission on the bus starts with the address of 
+	// the display it is from
+	if (_genieGetLinkState() != GENIE_LINK_RXREPORT && 
+		_genieGetLinkState() != GENIE_LINK_RXEVENT) {
+		if (!_genieRxAddressed) {
+			_genieRxDisplay = _genieFindDisplay(c);
+			_genieRxAddressed = TRUE;
+			return GENIE_EVENT_RXCHAR;
+		}
+		_genieRxAddressed = FALSE;
 	}
+#endif
 	
 	///////////////////////////////////////////
 	//
@@ -238,7 +679,7 @@ uint16_t genieDoEvents (void) {
 				case GENIE_REPORT_EVENT:
 				// event frame out of the blue, set the link state
 				// and fall through to the frame-accumulate code
-				// at the end of this function
+				// at the end of genieRxByte()
 				_geniePushLinkState(GENIE_LINK_RXEVENT);
 				break;
 					
@@ -254,11 +695,27 @@ uint16_t genieDoEvents (void) {
 			switch (c) {
 
 				case GENIE_ACK:
-					_geniePopLinkState();
+#ifdef GENIE_MULTIDROP
+					if (_genieRxDisplay != _genieLinkDisplay)
+						return GENIE_EVENT_RXCHAR;	// not the display we are waiting for
+					_genieDisplayStats[_genieRxDisplay].acks++;
+#endif
+					if (--_genieAcksPending == 0)
+						_geniePopLinkState();
+					_genieLinkAlive(_genieRxDisplay);
+					_genieReplyError = ERROR_NONE;
 					return GENIE_EVENT_RXCHAR;
 
 				case GENIE_NAK:
-					_geniePopLinkState();
+#ifdef GENIE_MULTIDROP
+					if (_genieRxDisplay != _genieLinkDisplay)
+						return GENIE_EVENT_RXCHAR;
+					_genieDisplayStats[_genieRxDisplay].naks++;
+#endif
+					if (--_genieAcksPending == 0)
+						_geniePopLinkState();
+					_genieLinkAlive(_genieRxDisplay);
+					_genieReplyError = ERROR_NAK;
 					_genieError = ERROR_NAK;
 					_handleError();
 					return GENIE_EVENT_RXCHAR;
@@ -266,7 +723,7 @@ uint16_t genieDoEvents (void) {
 				case GENIE_REPORT_EVENT:
 					// event frame out of the blue while waiting for an ACK
 					// save/set the link state and fall through to the 
-					// frame-accumulate code at the end of this function
+					// frame-accumulate code at the end of genieRxByte()
 					_geniePushLinkState(GENIE_LINK_RXEVENT);
 					break;
 
@@ -284,7 +741,7 @@ uint16_t genieDoEvents (void) {
 				// event frame out of the blue while waiting for the first
 				// byte of a report frame
 				// save/set the link state and fall through to the
-				// frame-accumulate code at the end of this function
+				// frame-accumulate code at the end of genieRxByte()
 				_geniePushLinkState(GENIE_LINK_RXEVENT);
 				break;
 
@@ -322,118 +779,852 @@ uint16_t genieDoEvents (void) {
 		_genieGetLinkState() == GENIE_LINK_RXEVENT) {
 			
 		checksum = (rxframe_count == 0) ? c : checksum ^ c;
+#ifdef GENIE_EVENT_TIMESTAMPS
+		if (rxframe_count == 0)
+			_genieRxStamp = micros();
+#endif
 
 		rx_data[rxframe_count] = c;
 
 		if (rxframe_count == GENIE_FRAME_SIZE -1) {
 			// all bytes received, if the CS is good 
 			// queue the frame and restore the link state
+#ifdef GENIE_MULTIDROP
+			if (_genieRxDisplay == GENIE_NO_DISPLAY) {
+				// from a display we don't know about, ignore it
+				rxframe_count = 0;
+				_geniePopLinkState();
+				return GENIE_EVENT_RXCHAR;
+			}
+#endif
 			if (checksum == 0) {
-				_genieEnqueueEvent(rx_data);
+				_genieCacheUpdate(rx_data);
+#ifndef GENIE_NO_LINK_MONITOR
+				if (_genieProbePending && rx_data[0] == GENIE_REPORT_OBJ &&
+					_genieRxDisplay == _genieProbeDisplay) {
+					// reply to a heartbeat or probe, the user didn't 
+					// ask for it so don't queue it. If the display 
+					// has failed to answer since it was last heard
+					// from it has probably restarted, otherwise the 
+					// form it reports is the one the user is on
+					_genieProbePending = FALSE;
+					if (_genieFatals(_genieRxDisplay) > 0)
+						_genieRestorePending = TRUE;
+					else
+						_genieCurrentForm = rx_data[4];
+				} else
+#endif
+				{
+					if (rx_data[0] == GENIE_REPORT_EVENT && rx_data[1] == GENIE_OBJ_FORM)
+						_genieCurrentForm = rx_data[2];
+					if (_genieFilterEvent(rx_data))
+						_genieEnqueueEvent(rx_data);
+				}
+				_genieLinkAlive(_genieRxDisplay);
 				rxframe_count = 0;
 				// revert the link state to whatever it was before
 				// we started accumulating this frame
 				_geniePopLinkState();
 				return GENIE_EVENT_RXCHAR;
 			} else {
+				// drop the frame and resync on the next one
 				_genieError = ERROR_BAD_CS;
 				_handleError();
+				rxframe_count = 0;
+				_geniePopLinkState();
+				return GENIE_EVENT_RXCHAR;
 			}	
 		}
 		rxframe_count++;
-		return GENIE_EVENT_RXCHAR;
 	}
+	return GENIE_EVENT_RXCHAR;
 }
 
-/////////////////// _genieFatalError ///////////////////////
+
+#ifdef GENIE_RX_INTERRUPT
+///////////////////////// genieRxInterrupt //////////////////////
+//
+// Pass every character waiting in the serial port's Rx buffer to
+// genieRxByte(). Call this from a timer interrupt, or any other 
+// interrupt that runs often enough to keep up with the display,
+// so frames are assembled even while loop() is busy.
 //
-void _genieFatalError(void) {
+// _genieGetchar() and genieRxByte() set _genieError, which the 
+// code this interrupted may be part way through using, so it is
+// put back as it was before returning.
+//
+void genieRxInterrupt (void) {
+	uint8_t c;
+	uint32_t start;
+	uint32_t elapsed;
+	int error = _genieError;
+
+	for (;;) {
+		start = micros();
+		c = _genieGetchar();
+		if (_genieError == ERROR_NOCHAR || _genieError == ERROR_NOHANDLER)
+			break;
+		genieRxByte(c);
 
-	if (_genieFatalErrors++ > MAX_GENIE_FATALS) {
-//		*_genieLinkState = GENIE_LINK_SHDN;
-//		_genieError = ERROR_NODISPLAY;
+		elapsed = micros() - start;
+		if (elapsed > _genieRxMaxTime)
+			_genieRxMaxTime = elapsed;
 	}
+	_genieError = error;
 }
 
-///////////////// _genieFlushSerialInput ///////////////////
+///////////////////////// genieGetRxMaxTime /////////////////////
 //
-// Removes and discards all characters from the currently 
-// used serial port's Rx buffer.
+// Returns:	The longest time in uS genieRxInterrupt() has taken to 
+//			receive and process a single character, the worst case
+//			is the last character of a frame
 //
-void _genieFlushSerialInput(void) {
-	do {
-		_genieGetchar();
-	} while (_genieError != ERROR_NOCHAR);
+uint32_t genieGetRxMaxTime (void) {
+	uint32_t t;
+
+	GENIE_LOCK();
+	t = _genieRxMaxTime;
+	GENIE_UNLOCK();
+	return t;
 }
+#endif
 
-/////////////////////// genieResync //////////////////////////
+/////////////////// _genieFatalError ///////////////////////
 //
-// This function does nothing for RESYNC_PERIOD to allow the display 
-// time to stop talking, then it flushes everything so the link 
-// can start again.
+// Count a failure of a display to respond, enough of them
+// in a row and the display is declared down. Without the link
+// monitor nothing would probe it back up so they are just counted.
 //
-// Untested, will need work I'm sure.
+// Parms:	uint8_t d, the display that didn't respond
 //
-void genieResync (void) {
-	
-	for (long timeout = millis() + RESYNC_PERIOD ; millis() < timeout;) {};
+void _genieFatalError(uint8_t d) {
+	bool down = FALSE;
 
-	_genieFlushSerialInput();
-	_genieFlushEventQueue();
-	_genieTimeouts = 0;
-	_genieGetLinkState() == GENIE_LINK_IDLE;
+	GENIE_LOCK();
+#ifdef GENIE_NO_LINK_MONITOR
+	++_genieFatals(d);
+#else
+	if (++_genieFatals(d) >= _genieMaxFatals && !_genieDown(d)) {
+		_genieDown(d) = TRUE;
+		down = TRUE;
+	}
+#endif
+	GENIE_UNLOCK();
 
+	if (down) {
+		_genieError = ERROR_NODISPLAY;
+		_handleError();
+	}
 }
 
-///////////////////////// _handleError /////////////////////////
+/////////////////// _genieLinkAlive ////////////////////////
 //
-// So far really just a debugging aid, but can be enhanced to
-// help recover from errors.
+// Called whenever a display sends something valid. Clears
+// its failure count and if it was down marks it as up again. 
+// The mirror is replayed when the link is next idle, the 
+// display has probably restarted.
 //
-void _handleError (void) {
-//	Serial2.write (_genieError + (1<<5));
-//	if (_genieError == GENIE_NAK) genieResync();
+// Parms:	uint8_t d, the display heard from
+//
+void _genieLinkAlive(uint8_t d) {
+
+	_genieFatals(d) = 0;
+
+	if (!_genieDown(d))
+		return;
+
+	_genieDown(d) = FALSE;
+	_genieRestorePending = TRUE;
 }
 
-////////////////////// _genieFlushEventQueue ////////////////////
+#ifndef GENIE_NO_LINK_MONITOR
+/////////////////// _genieSendProbe ////////////////////////
 //
-// Reset all the event queue variables and start from scratch.
+// Send a read of the current form to check a display is 
+// there. The reply is not passed to the user's handler.
 //
-void _genieFlushEventQueue(void) {
-	_genieEventQueue.rd_index = 0;
-	_genieEventQueue.wr_index = 0;
-	_genieEventQueue.n_events = 0;
+// Parms:	uint8_t d, the display to probe
+//
+void _genieSendProbe(uint8_t d) {
+	uint8_t frame[4];
+	bool claimed = FALSE;
+
+	GENIE_LOCK();
+	if (_genieGetLinkState() == GENIE_LINK_IDLE) {
+		_geniePushLinkState(GENIE_LINK_WF_RXREPORT);
+		_genieProbePending = TRUE;
+		_genieProbeSent = millis();
+		_genieProbeDisplay = d;
+		claimed = TRUE;
+	}
+	GENIE_UNLOCK();
+
+	if (!claimed)
+		return;
+
+#ifdef GENIE_MULTIDROP
+	_genieSendAddress(d);
+#endif
+	frame[0] = GENIE_READ_OBJ;
+	frame[1] = GENIE_OBJ_FORM;
+	frame[2] = 0;
+	frame[3] = GENIE_READ_OBJ ^ GENIE_OBJ_FORM;
+	_genieWrite(frame, 4);
 }
 
-////////////////////// genieDequeueEvent ///////////////////
+/////////////////// _genieLinkMonitor //////////////////////
+//
+// Called by genieDoEvents() when there is nothing to receive. 
+// Times out an unanswered probe and sends a new one when a 
+// display is down or the link has been quiet for a while. With
+// GENIE_MULTIDROP the displays are taken in turn, those that are 
+// down are probed however busy the others keep the bus and those
+// that are up are sent heartbeats while it is quiet.
+//
+void _genieLinkMonitor(void) {
+	uint32_t now = millis();
+	uint32_t quiet;
+	uint8_t d;
+
+#if MAX_GENIE_MIRROR > 0
+	if (_genieRestorePending && _genieLinkIdle()) {
+		_genieRestorePending = FALSE;
+		genieRestoreState();
+		return;
+	}
+#endif
+
+	// A probe gets PROBE_TIMEOUT mS from when it was sent or the last
+	// character of its reply arrived, not the full command timeout,
+	// so a dead display only holds the link that long
+	if (_genieProbePending) {
+		GENIE_LOCK();
+		quiet = millis() - _genieLastActivity;
+		GENIE_UNLOCK();
+		if (quiet >= PROBE_TIMEOUT) {
+			_genieResetLinkState();
+			_genieFatalError(_genieProbeDisplay);
+		}
+		return;
+	}
+
+	if (!_genieLinkIdle() || _geniePutCharHandler == NULL)
+		return;
+
+	GENIE_LOCK();
+	quiet = now - _genieLastActivity;
+	GENIE_UNLOCK();
+
+	if (now - _genieProbeSent >= _genieProbePeriod && _genieNextProbe(TRUE, &d))
+		_genieSendProbe(d);
+	else if (_genieHeartbeatPeriod != 0 && quiet >= _genieHeartbeatPeriod && _genieNextProbe(FALSE, &d))
+		_genieSendProbe(d);
+}
+
+/////////////////// _genieNextProbe ////////////////////////
 //
-// Copy the bytes from a queued input event to a buffer supplied 
-// by the caller.
+// Find the next display after the one last probed that is, or 
+// isn't, down.
 //
-// Parms:	genieFrame * buff, a pointer to the user's buffer
+// Parms:	bool down, TRUE for a display that is down
+//			uint8_t * d, set to the display
 //
-// Returns:	TRUE if there was an event to copy
-//			FALSE if not
+// Returns:	TRUE if there is one
 //
-bool genieDequeueEvent(genieFrame * buff) {
+bool _genieNextProbe(bool down, uint8_t * d) {
+	uint8_t i;
 
-	if (_genieEventQueue.n_events > 0) {
-		memcpy (buff, &_genieEventQueue.frames[_genieEventQueue.rd_index], 
-				GENIE_FRAME_SIZE);
-		_genieEventQueue.rd_index++;
-		_genieEventQueue.rd_index &= MAX_GENIE_EVENTS -1;
-		_genieEventQueue.n_events--;
-		return TRUE;
-	} 
+	for (i = 1; i <= _genieNumDisplays; i++) {
+		*d = (_genieProbeDisplay + i) % _genieNumDisplays;
+		if (_genieDown(*d) == down)
+			return TRUE;
+	}
 	return FALSE;
 }
+#endif
 
-////////////////////// _genieEnqueueEvent ///////////////////
-//
-// Copy the bytes from a buffer supplied by the caller 
-// to the input queue 
+/////////////////// _genieMirrorWrite //////////////////////
 //
-// Parms:	uint8_t * data, a pointer to the user's data
+// Remember the value written to an object. Form writes just 
+// record the active form. If the mirror is full the value is
+// not remembered.
+//
+void _genieMirrorWrite(uint8_t object, uint8_t index, uint16_t value) {
+#if MAX_GENIE_MIRROR > 0
+	genieMirrorEntryStruct * m;
+#endif
+
+	if (object == GENIE_OBJ_FORM) {
+		_genieCurrentForm = index;
+		return;
+	}
+
+#if MAX_GENIE_MIRROR > 0
+
+	for (m = _genieMirror; m < &_genieMirror[_genieMirrorCount]; m++) {
+		if (m->object == object && m->index == index) {
+			m->value = value;
+			m->form = _genieCurrentForm;
+			return;
+		}
+	}
+
+	if (_genieMirrorCount < MAX_GENIE_MIRROR) {
+		m->object = object;
+		m->index = index;
+		m->value = value;
+		m->form = _genieCurrentForm;
+		_genieMirrorCount++;
+	}
+#endif
+}
+
+#ifndef GENIE_NO_STRINGS
+/////////////////// _genieMirrorStrText ////////////////////
+//
+// Make room to remember a string of len characters written to a
+// string object, for the caller to copy in. As _genieMirrorStr()
+// an older copy is forgotten if it can't be remembered.
+//
+// Returns:	Where the len characters go, they are terminated
+//			NULL if the string isn't remembered
+//
+char * _genieMirrorStrText(uint8_t code, uint8_t index, uint8_t len) {
+#if MAX_GENIE_MIRROR_STRS > 0
+	genieMirrorStrStruct * m;
+	genieMirrorStrStruct * slot = NULL;
+
+	for (m = _genieMirrorStrs; m < &_genieMirrorStrs[MAX_GENIE_MIRROR_STRS]; m++) {
+		if (m->code != 0 && m->index == index) {
+			slot = m;
+			break;
+		}
+		if (m->code == 0 && slot == NULL)
+			slot = m;
+	}
+
+	if (slot == NULL)
+		return NULL;
+
+	if (len > MAX_GENIE_MIRROR_STR_LEN) {
+		if (slot->index == index)
+			slot->code = 0;
+		return NULL;
+	}
+
+	slot->code = code;
+	slot->index = index;
+	slot->text[len] = 0;
+	return slot->text;
+#else
+	return NULL;
+#endif
+}
+
+/////////////////// _genieMirrorStr ////////////////////////
+//
+// Remember the string written to a string object. If it is too
+// long, or there is no room, any older copy is forgotten so a 
+// stale string is not restored.
+//
+void _genieMirrorStr(uint8_t code, uint8_t index, const char * string, uint8_t len) {
+	char * text = _genieMirrorStrText(code, index, len);
+
+	if (text != NULL)
+		memcpy(text, string, len);
+}
+#endif
+
+/////////////////// _genieFlushMirror ///////////////////////
+//
+// Forget everything written to the display.
+//
+void _genieFlushMirror(void) {
+
+#if MAX_GENIE_MIRROR > 0
+	_genieMirrorCount = 0;
+#endif
+#if MAX_GENIE_MIRROR_STRS > 0
+	for (uint8_t i = 0; i < MAX_GENIE_MIRROR_STRS; i++)
+		_genieMirrorStrs[i].code = 0;
+#endif
+	_genieCurrentForm = 0;
+	_genieContrast = -1;
+}
+
+#if MAX_GENIE_MIRROR > 0
+/////////////////// genieRestoreState //////////////////////
+//
+// Replay the mirror to the display as one burst of commands, 
+// the ACKs are collected at the end. Objects are written form
+// by form with the active form last, then the strings, the 
+// contrast and finally the active form is reselected.
+//
+// This is called automatically when the display comes back 
+// after being down or is seen to have restarted, it can also
+// be called after the user has reset the display.
+//
+// Returns:	The number of mS the replay took
+//
+uint32_t genieRestoreState(void) {
+	genieMirrorEntryStruct * m;
+	uint32_t start = millis();
+	uint16_t n = 0;
+	uint16_t form, max_form = 0;
+	uint8_t frame[3];
+
+	// the number of frames that will be sent, each one is ACKed
+	n = _genieMirrorCount + 1;
+#if MAX_GENIE_MIRROR_STRS > 0
+	genieMirrorStrStruct * s;
+	for (s = _genieMirrorStrs; s < &_genieMirrorStrs[MAX_GENIE_MIRROR_STRS]; s++) {
+		if (s->code != 0)
+			n++;
+	}
+#endif
+	if (_genieContrast >= 0)
+		n++;
+
+	if (!_genieWaitForLink(GENIE_LINK_WFAN))
+		return 0;
+	GENIE_LOCK();
+	_genieAcksPending = n;
+	GENIE_UNLOCK();
+
+	for (m = _genieMirror; m < &_genieMirror[_genieMirrorCount]; m++) {
+		if (m->form > max_form)
+			max_form = m->form;
+	}
+
+	// form numbers from 0 to max_form then the current form again,
+	// skipping the current form the first time around
+	for (form = 0; form <= max_form + 1; form++) {
+		uint8_t f = (form > max_form) ? _genieCurrentForm : form;
+
+		if (form <= max_form && f == _genieCurrentForm)
+			continue;
+		for (m = _genieMirror; m < &_genieMirror[_genieMirrorCount]; m++) {
+			if (m->form == f)
+				_genieSendWriteObj(m->object, m->index, m->value);
+		}
+	}
+
+#if MAX_GENIE_MIRROR_STRS > 0
+	for (s = _genieMirrorStrs; s < &_genieMirrorStrs[MAX_GENIE_MIRROR_STRS]; s++) {
+		if (s->code != 0)
+			_genieSendStr(s->code, s->index, s->text, strlen(s->text));
+	}
+#endif
+
+	if (_genieContrast >= 0) {
+		frame[0] = GENIE_WRITE_CONTRAST;
+		frame[1] = _genieContrast;
+		frame[2] = frame[0] ^ frame[1];
+		_genieWrite(frame, 3);
+	}
+
+	_genieSendWriteObj(GENIE_OBJ_FORM, _genieCurrentForm, 0);
+
+	_genieWaitForIdle();
+
+	return millis() - start;
+}
+#endif
+
+#ifndef GENIE_NO_LINK_MONITOR
+/////////////////// genieSetLinkHealth /////////////////////
+//
+// Configure the link health monitor.
+//
+// Parms:	uint8_t max_failures, the number of consecutive timeouts
+//				before the display is declared down
+//			uint16_t heartbeat, mS of link inactivity before the 
+//				display is checked, 0 to disable the heartbeat
+//			uint16_t probe, mS between attempts to reach the display
+//				while it is down
+//
+// Heartbeats and probes wait PROBE_TIMEOUT mS for their reply, not
+// the command timeout, so a dead display holds up the sketch for 
+// no longer than that each time it is probed.
+//
+void genieSetLinkHealth(uint8_t max_failures, uint16_t heartbeat, uint16_t probe) {
+	_genieMaxFatals = max_failures;
+	_genieHeartbeatPeriod = heartbeat;
+	_genieProbePeriod = probe;
+}
+#endif
+
+/////////////////// genieLinkIsUp //////////////////////////
+//
+// Returns:	TRUE if the display, the selected one with 
+//				GENIE_MULTIDROP, is responding
+//			FALSE if it has been declared down, in which case
+//				commands to it return ERROR_NODISPLAY without waiting
+//
+bool genieLinkIsUp(void) {
+#ifdef GENIE_MULTIDROP
+	if (_genieNumDisplays == 0)
+		return FALSE;
+#endif
+	return !_genieDown(_genieTxDisplay);
+}
+
+#ifdef GENIE_MULTIDROP
+/////////////////// _genieFindDisplay //////////////////////
+//
+// Returns:	The number of the display with the given address
+//			GENIE_NO_DISPLAY if it hasn't been added
+//
+uint8_t _genieFindDisplay(uint8_t address) {
+	uint8_t d;
+
+	for (d = 0; d < _genieNumDisplays; d++) {
+		if (_genieDisplayAddrs[d] == address)
+			return d;
+	}
+	return GENIE_NO_DISPLAY;
+}
+
+/////////////////// _genieSendAddress //////////////////////
+//
+// Start a command to a display, any reply to it is expected 
+// from the same display.
+//
+// Parms:	uint8_t d, the display
+//
+void _genieSendAddress(uint8_t d) {
+	_genieLinkDisplay = d;
+	_geniePutchar(_genieDisplayAddrs[d]);
+}
+
+#ifndef GENIE_WRITE_ONLY
+/////////////////// _genieNextEventDisplay /////////////////
+//
+// Choose the display whose events the user's handler is given
+// next, the next one after the last that has any queued, so a 
+// busy display can't hold up the others.
+//
+void _genieNextEventDisplay(void) {
+	uint8_t i, d;
+
+	for (i = 1; i <= _genieNumDisplays; i++) {
+		d = (_genieEventDisplay + i) % _genieNumDisplays;
+		if (_genieEventQueues[d].n_events > 0) {
+			_genieEventDisplay = d;
+			return;
+		}
+	}
+}
+
+/////////////////// genieGetEventDisplay ///////////////////
+//
+// Returns:	The address of the display the events returned by 
+//			genieDequeueEvent() and geniePeekEvents() come from
+//
+uint8_t genieGetEventDisplay(void) {
+	return _genieDisplayAddrs[_genieEventDisplay];
+}
+#endif
+
+/////////////////// genieAddDisplay ////////////////////////
+//
+// Add a display to the bus.
+//
+// Parms:	uint8_t address, the display's address, the Destination
+//				in its project's Options
+//
+// Returns:	TRUE if the display was added or was already there
+//			FALSE if MAX_GENIE_DISPLAYS have been added
+//
+bool genieAddDisplay(uint8_t address) {
+
+	if (_genieFindDisplay(address) != GENIE_NO_DISPLAY)
+		return TRUE;
+	if (_genieNumDisplays >= MAX_GENIE_DISPLAYS)
+		return FALSE;
+
+	memset(&_genieDisplayStats[_genieNumDisplays], 0, sizeof(genieDisplayStatsStruct));
+	_genieDisplayAddrs[_genieNumDisplays] = address;
+	GENIE_LOCK();
+	_genieNumDisplays++;
+	GENIE_UNLOCK();
+	return TRUE;
+}
+
+/////////////////// genieSelectDisplay /////////////////////
+//
+// Choose the display that commands are sent to. A command already
+// sent to another display is still waited for.
+//
+// Parms:	uint8_t address, the display's address
+//
+// Returns:	TRUE if the display is selected
+//			FALSE if it hasn't been added
+//
+bool genieSelectDisplay(uint8_t address) {
+	uint8_t d = _genieFindDisplay(address);
+
+	if (d == GENIE_NO_DISPLAY)
+		return FALSE;
+	_genieTxDisplay = d;
+	return TRUE;
+}
+
+/////////////////// genieGetDisplayStats ///////////////////
+//
+// Copy a display's ACK, NAK, timeout and event counts.
+//
+// Parms:	uint8_t address, the display's address
+//			genieDisplayStatsStruct * stats, set to its counts
+//
+// Returns:	TRUE if the display has been added
+//			FALSE if not, stats is not changed
+//
+bool genieGetDisplayStats(uint8_t address, genieDisplayStatsStruct * stats) {
+	uint8_t d = _genieFindDisplay(address);
+
+	if (d == GENIE_NO_DISPLAY)
+		return FALSE;
+	GENIE_LOCK();
+	*stats = _genieDisplayStats[d];
+	GENIE_UNLOCK();
+	return TRUE;
+}
+#endif
+
+///////////////// _genieFlushSerialInput ///////////////////
+//
+// Removes and discards all characters from the currently 
+// used serial port's Rx buffer.
+//
+void _genieFlushSerialInput(void) {
+	do {
+		_genieGetchar();
+	} while (_genieError != ERROR_NOCHAR);
+}
+
+/////////////////////// genieResync //////////////////////////
+//
+// This function does nothing for RESYNC_PERIOD to allow the display 
+// time to stop talking, then it flushes everything so the link 
+// can start again.
+//
+// Untested, will need work I'm sure.
+//
+void genieResync (void) {
+	
+	for (long timeout = millis() + RESYNC_PERIOD ; millis() < timeout;) {};
+
+	_genieFlushSerialInput();
+	_genieFlushEventQueue();
+	_genieTimeouts = 0;
+	_genieResetLinkState();
+
+}
+
+///////////////////////// _handleError /////////////////////////
+//
+// So far really just a debugging aid, but can be enhanced to
+// help recover from errors.
+//
+void _handleError (void) {
+//	Serial2.write (_genieError + (1<<5));
+//	if (_genieError == GENIE_NAK) genieResync();
+}
+
+#ifndef GENIE_WRITE_ONLY
+////////////////////// _genieFlushEventQueue ////////////////////
+//
+// Reset all the event queue variables and start from scratch.
+//
+void _genieFlushEventQueue(void) {
+	genieEventQueueStruct * q;
+
+	GENIE_LOCK();
+	for (q = _genieEventQueues; 
+		 q < &_genieEventQueues[sizeof(_genieEventQueues) / sizeof(_genieEventQueues[0])]; q++) {
+#ifdef GENIE_EVENT_TIMESTAMPS
+		q->n_undispatched = 0;
+#endif
+		q->rd_index = 0;
+		q->wr_index = 0;
+		q->n_events = 0;
+#ifdef GENIE_QUEUE_STATS
+		_genieQueueLevel(&q->stats, 0);
+#endif
+	}
+	GENIE_UNLOCK();
+}
+
+////////////////////// genieDequeueEvent ///////////////////
+//
+// Copy the bytes from a queued input event to a buffer supplied 
+// by the caller.
+//
+// Parms:	genieFrame * buff, a pointer to the user's buffer
+//
+// Returns:	TRUE if there was an event to copy
+//			FALSE if not
+//
+bool genieDequeueEvent(genieFrame * buff) {
+
+	if (_genieEventQueue.n_events > 0) {
+		memcpy (buff, &_genieEventQueue.frames[_genieEventQueue.rd_index], 
+				GENIE_FRAME_SIZE);
+		genieConsumeEvents(1);
+		return TRUE;
+	} 
+	return FALSE;
+}
+
+////////////////////// geniePeekEvents /////////////////////
+//
+// Give the caller direct access to the queued input events
+// without copying them out of the queue. The frames stay in the
+// queue until released with genieConsumeEvents(). Reads made from
+// the handler in between leave the queue alone, genieBegin() 
+// empties it so must not be called before consuming.
+//
+// Parms:	uint8_t * count, set to the number of frames that
+//				can be read contiguously from the returned pointer,
+//				this may be less than the number queued if the
+//				queue has wrapped
+//
+// Returns:	A pointer to the oldest queued frame
+//			NULL if there are no events (count is set to 0)
+//
+const genieFrame * geniePeekEvents(uint8_t * count) {
+	uint8_t to_end;
+
+	if (_genieEventQueue.n_events == 0) {
+		*count = 0;
+		return NULL;
+	}
+
+	to_end = MAX_GENIE_EVENTS - _genieEventQueue.rd_index;
+	*count = (_genieEventQueue.n_events < to_end) ? 
+				_genieEventQueue.n_events : to_end;
+
+	return &_genieEventQueue.frames[_genieEventQueue.rd_index];
+}
+
+////////////////////// genieConsumeEvents //////////////////
+//
+// Release one or more frames from the head of the event queue,
+// normally after processing them in place via geniePeekEvents().
+//
+// Parms:	uint8_t count, the number of frames to release, this 
+//				is clipped to the number actually queued
+//
+void genieConsumeEvents(uint8_t count) {
+
+	GENIE_LOCK();
+	if (count > _genieEventQueue.n_events)
+		count = _genieEventQueue.n_events;
+
+#ifdef GENIE_EVENT_TIMESTAMPS
+	uint32_t now = micros();
+	for (uint8_t i = 0; i < count; i++) {
+		_genieRecordLatency(&_genieResidenceLatency, now - 
+			_genieEventQueue.stamps[(_genieEventQueue.rd_index + i) & (MAX_GENIE_EVENTS -1)]);
+	}
+	if (_genieEventQueue.n_undispatched > _genieEventQueue.n_events - count)
+		_genieEventQueue.n_undispatched = _genieEventQueue.n_events - count;
+#endif
+
+	_genieEventQueue.rd_index += count;
+	_genieEventQueue.rd_index &= MAX_GENIE_EVENTS -1;
+	_genieEventQueue.n_events -= count;
+#ifdef GENIE_QUEUE_STATS
+	_genieQueueLevel(&_genieEventQueue.stats, _genieEventQueue.n_events);
+#endif
+	GENIE_UNLOCK();
+}
+
+#ifdef GENIE_EVENT_TIMESTAMPS
+////////////////////// genieDequeueEventTimed ////////////////
+//
+// As genieDequeueEvent() but also returns the micros() time 
+// the first byte of the frame was received.
+//
+// Parms:	genieFrame * buff, a pointer to the user's buffer
+//			uint32_t * stamp, set to the frame's receive time
+//
+bool genieDequeueEventTimed(genieFrame * buff, uint32_t * stamp) {
+
+	if (_genieEventQueue.n_events > 0) {
+		*stamp = _genieEventQueue.stamps[_genieEventQueue.rd_index];
+		return genieDequeueEvent(buff);
+	}
+	return FALSE;
+}
+
+////////////////////// geniePeekEventTimes ///////////////////
+//
+// Returns:	A pointer to the receive times of the frames returned
+//			by geniePeekEvents(), in the same order
+//
+const uint32_t * geniePeekEventTimes(void) {
+	return &_genieEventQueue.stamps[_genieEventQueue.rd_index];
+}
+
+////////////////////// _genieRecordLatency ///////////////////
+//
+void _genieRecordLatency(genieLatencyStruct * l, uint32_t us) {
+	l->count++;
+	l->total += us;
+	if (us > l->max)
+		l->max = us;
+}
+
+////////////////////// _genieRecordDispatch //////////////////
+//
+// Called just before the user's handler, records the dispatch 
+// latency of the frames queued since it was last called.
+//
+void _genieRecordDispatch(void) {
+	uint32_t now = micros();
+	uint8_t i;
+
+	GENIE_LOCK();
+	for (i = 1; i <= _genieEventQueue.n_undispatched; i++) {
+		_genieRecordLatency(&_genieDispatchLatency, now - 
+			_genieEventQueue.stamps[(_genieEventQueue.wr_index - i) & (MAX_GENIE_EVENTS -1)]);
+	}
+	_genieEventQueue.n_undispatched = 0;
+	GENIE_UNLOCK();
+}
+
+////////////////////// genieGetLatencyStats //////////////////
+//
+// Copy the latency statistics, either pointer may be NULL. The
+// average is total / count.
+//
+void genieGetLatencyStats(genieLatencyStruct * dispatch, genieLatencyStruct * residence) {
+	GENIE_LOCK();
+	if (dispatch != NULL)
+		*dispatch = _genieDispatchLatency;
+	if (residence != NULL)
+		*residence = _genieResidenceLatency;
+	GENIE_UNLOCK();
+}
+
+////////////////////// genieResetLatencyStats ////////////////
+//
+void genieResetLatencyStats(void) {
+	GENIE_LOCK();
+	memset(&_genieDispatchLatency, 0, sizeof(_genieDispatchLatency));
+	memset(&_genieResidenceLatency, 0, sizeof(_genieResidenceLatency));
+	GENIE_UNLOCK();
+}
+#endif
+
+////////////////////// _genieEnqueueEvent ///////////////////
+//
+// Copy the bytes from a buffer supplied by the caller 
+// to the input queue of the display they came from
+//
+// Parms:	uint8_t * data, a pointer to the user's data
 //
 // Returns:	TRUE if there was an empty location in the queue
 //				to copy the data into
@@ -441,176 +1632,1075 @@ bool genieDequeueEvent(genieFrame * buff) {
 // Sets:	ERROR_REPLY_OVR if there was no room in the queue
 //
 bool _genieEnqueueEvent (uint8_t * data) {
+	genieEventQueueStruct * q = &_genieEventQueues[_genieRxDisplay];
 
-	if (_genieEventQueue.n_events < MAX_GENIE_EVENTS-2) {
-		memcpy (&_genieEventQueue.frames[_genieEventQueue.wr_index], data, 
-				GENIE_FRAME_SIZE);
-		_genieEventQueue.wr_index++;
-		_genieEventQueue.wr_index &= MAX_GENIE_EVENTS -1;
-		_genieEventQueue.n_events++;
+	if (q->n_events < MAX_GENIE_EVENTS-2) {
+		memcpy (&q->frames[q->wr_index], data, GENIE_FRAME_SIZE);
+#ifdef GENIE_EVENT_TIMESTAMPS
+		q->stamps[q->wr_index] = _genieRxStamp;
+		q->n_undispatched++;
+#endif
+		q->wr_index++;
+		q->wr_index &= MAX_GENIE_EVENTS -1;
+		q->n_events++;
+#ifdef GENIE_QUEUE_STATS
+		q->stats.queued++;
+		_genieQueueLevel(&q->stats, q->n_events);
+#endif
+#ifdef GENIE_MULTIDROP
+		_genieDisplayStats[_genieRxDisplay].events++;
+#endif
 		return TRUE;
 	} else {
+#ifdef GENIE_QUEUE_STATS
+		q->stats.overflows++;
+#endif
+#ifdef GENIE_MULTIDROP
+		_genieDisplayStats[_genieRxDisplay].drops++;
+#endif
 		_genieError = ERROR_REPLY_OVR;
 		_handleError();
 		return FALSE;
 	}
 }
+#endif
+
+#if MAX_GENIE_FILTERS > 0
+////////////////////// _genieFilterEvent ////////////////////
+//
+// Run a received frame through the filter table
+//
+// Parms:	uint8_t * data, a pointer to the frame's bytes
+//
+// Returns:	TRUE if the frame should be queued
+//			FALSE if it should be dropped, the drop is counted
+//				against the filter that rejected it
+//
+bool _genieFilterEvent (uint8_t * data) {
+	genieEventFilterStruct * f;
+	genieFrameReportObj * r = (genieFrameReportObj *)data;
+
+	for (f = _genieEventFilters; f < &_genieEventFilters[_genieNumFilters]; f++) {
+		if (r->cmd < 8 && (f->cmd_mask & GENIE_CMD_BIT(r->cmd)) &&
+			r->object < 32 && (f->object_mask & GENIE_OBJ_BIT(r->object)) &&
+			r->index >= f->index_min && r->index <= f->index_max) {
+
+			if (f->action == GENIE_FILTER_ALLOW) 
+				return TRUE;
+			f->drops++;
+			return FALSE;
+		}
+	}
+
+	if (_genieFilterDefault == GENIE_FILTER_ALLOW)
+		return TRUE;
+	_genieFilterDefaultDrops++;
+	return FALSE;
+}
+
+/////////////////////// genieAddEventFilter //////////////////////
+//
+// Add a filter to the end of the filter table. Filters are tested 
+// in the order they were added.
+//
+// Parms:	uint8_t action, GENIE_FILTER_ALLOW or GENIE_FILTER_DENY
+//			uint8_t cmd_mask, commands the filter applies to
+//			uint32_t object_mask, object types the filter applies to
+//			uint8_t index_min, uint8_t index_max, the inclusive range
+//				of object indexes the filter applies to, use 0 and
+//				255 for all
+//
+// Returns:	The filter number, used with genieGetFilterDrops()
+//			-1 if the table is full
+//
+int8_t genieAddEventFilter (uint8_t action, uint8_t cmd_mask, uint32_t object_mask,
+							uint8_t index_min, uint8_t index_max) {
+	genieEventFilterStruct * f;
+
+	if (_genieNumFilters >= MAX_GENIE_FILTERS)
+		return -1;
+
+	f = &_genieEventFilters[_genieNumFilters];
+	f->action		= action;
+	f->cmd_mask		= cmd_mask;
+	f->object_mask	= object_mask;
+	f->index_min	= index_min;
+	f->index_max	= index_max;
+	f->drops		= 0;
+
+	return _genieNumFilters++;
+}
+
+/////////////////////// genieClearEventFilters ////////////////////
+//
+// Remove all filters and their drop counts, and revert to 
+// queuing every frame.
+//
+void genieClearEventFilters (void) {
+	_genieNumFilters = 0;
+	_genieFilterDefault = GENIE_FILTER_ALLOW;
+	_genieFilterDefaultDrops = 0;
+}
+
+/////////////////////// genieSetFilterDefault /////////////////////
+//
+// Set what happens to frames that don't match any filter.
+//
+// Parms:	uint8_t action, GENIE_FILTER_ALLOW or GENIE_FILTER_DENY
+//
+void genieSetFilterDefault (uint8_t action) {
+	_genieFilterDefault = action;
+}
+
+/////////////////////// genieGetFilterDrops ///////////////////////
+//
+// Parms:	uint8_t filter, a number returned by genieAddEventFilter()
+//				or GENIE_FILTER_DEFAULT
+//
+// Returns:	The number of frames dropped by that filter
+//
+uint16_t genieGetFilterDrops (uint8_t filter) {
+
+	if (filter == GENIE_FILTER_DEFAULT)
+		return _genieFilterDefaultDrops;
+	if (filter < _genieNumFilters)
+		return _genieEventFilters[filter].drops;
+	return 0;
+}
+#endif
+
+#if MAX_GENIE_CACHE > 0
+////////////////////// _genieCacheFind ///////////////////////
+//
+// Returns:	A pointer to the cache entry for the object, or
+//			NULL if the object is not cached
+//
+static genieCacheEntryStruct * _genieCacheFind (uint8_t display, uint8_t object, uint8_t index) {
+	genieCacheEntryStruct * e;
+
+	for (e = _genieCache; e < &_genieCache[MAX_GENIE_CACHE]; e++) {
+#ifdef GENIE_MULTIDROP
+		if (e->display != display)
+			continue;
+#endif
+		if (e->object == object && e->index == index)
+			return e;
+	}
+	return NULL;
+}
+
+////////////////////// _genieCacheUpdate /////////////////////
+//
+// Record the value carried by a received REPORT_EVENT or 
+// REPORT_OBJ frame, other frames are ignored.
+//
+// Parms:	uint8_t * data, a pointer to the frame's bytes
+//
+void _genieCacheUpdate (uint8_t * data) {
+	genieCacheEntryStruct * e;
+	genieCacheEntryStruct * oldest;
+	genieFrameReportObj * r = (genieFrameReportObj *)data;
+	uint32_t now = millis();
+
+	if (r->cmd != GENIE_REPORT_EVENT && r->cmd != GENIE_REPORT_OBJ)
+		return;
+
+	e = _genieCacheFind(_genieRxDisplay, r->object, r->index);
+
+	if (e == NULL) {
+		// not cached yet, use an empty entry if there is one 
+		// or else the one that has gone longest without an update
+		e = _genieCacheFind(GENIE_CACHE_EMPTY, GENIE_CACHE_EMPTY, GENIE_CACHE_EMPTY);
+		if (e == NULL) {
+			oldest = _genieCache;
+			for (e = _genieCache; e < &_genieCache[MAX_GENIE_CACHE]; e++) {
+				if (now - e->stamp > now - oldest->stamp)
+					oldest = e;
+			}
+			e = oldest;
+		}
+		e->object = r->object;
+		e->index = r->index;
+#ifdef GENIE_MULTIDROP
+		e->display = _genieRxDisplay;
+#endif
+	}
+
+	e->value = (r->data_msb << 8) + r->data_lsb;
+	e->stamp = now;
+}
+
+////////////////////// _genieFlushCache //////////////////////
+//
+// Mark all the cache entries as unused.
+//
+void _genieFlushCache (void) {
+	genieCacheEntryStruct * e;
+
+	GENIE_LOCK();
+	for (e = _genieCache; e < &_genieCache[MAX_GENIE_CACHE]; e++) {
+		e->object = GENIE_CACHE_EMPTY;
+		e->index = GENIE_CACHE_EMPTY;
+#ifdef GENIE_MULTIDROP
+		e->display = GENIE_CACHE_EMPTY;
+#endif
+	}
+	GENIE_UNLOCK();
+}
+
+////////////////////// genieGetCachedValue ///////////////////
+//
+// Get the last value the display reported for an object without 
+// talking to the display. With GENIE_MULTIDROP the selected 
+// display's values are returned.
+//
+// Parms:	uint16_t object, uint16_t index, the object to look up
+//			uint16_t * value, set to the cached value
+//			uint32_t * age, set to the number of mS since the value
+//				was received, may be NULL
+//
+// Returns:	TRUE if the object was in the cache
+//			FALSE if not, value and age are not changed
+//
+bool genieGetCachedValue (uint16_t object, uint16_t index, uint16_t * value, uint32_t * age) {
+	genieCacheEntryStruct * e;
+	uint32_t stamp;
+
+	GENIE_LOCK();
+	e = _genieCacheFind(_genieTxDisplay, object, index);
+	if (e != NULL) {
+		*value = e->value;
+		stamp = e->stamp;
+	}
+	GENIE_UNLOCK();
+
+	if (e == NULL)
+		return FALSE;
+
+	if (age != NULL)
+		*age = millis() - stamp;
+	return TRUE;
+}
+
+////////////////////// genieReadCachedObject /////////////////
+//
+// Get an object's value from the cache if it is no older than
+// ttl mS, otherwise read it from the display and wait for the
+// reply. Unlike genieReadObject() the event queue is not flushed
+// first, events already queued are kept, and the reply is queued
+// for the user's event handler as well as cached.
+//
+// Parms:	uint16_t object, uint16_t index, the object to read
+//			uint32_t ttl, the maximum acceptable age of the cached 
+//				value in mS
+//			uint16_t * value, set to the object's value
+//
+// Returns:	TRUE if a value was returned
+//			FALSE if the display did not reply in time
+//
+bool genieReadCachedObject (uint16_t object, uint16_t index, uint32_t ttl, uint16_t * value) {
+	uint32_t age;
+	uint32_t start;
+
+	if (genieGetCachedValue(object, index, value, &age) && age <= ttl)
+		return TRUE;
+
+	start = millis();
+	if (!_genieSendRead(object, index))
+		return FALSE;
+	_genieWaitForIdle();
+
+	// only accept a value that arrived after the read was sent
+	return (genieGetCachedValue(object, index, value, &age) && 
+			age <= millis() - start);
+}
+#endif
+
+#ifndef GENIE_WRITE_ONLY
+//////////////////////// genieReadObject ///////////////////////
+//
+// Send a read object command to the Genie display. Note that this 
+// function does not wait for the reply, that will be read in due 
+// course by genieDoEvents() and subsequently by the user's event 
+// handler.
+//
+// Called from the user's handler the queue is left alone, the 
+// handler may be part way through frames it has peeked at.
+//
+bool genieReadObject (uint16_t object, uint16_t index) {
+
+	if (!_genieInHandler)
+		_genieFlushEventQueue();	// Discard any pending reply frames
+
+	return _genieSendRead(object, index);
+}
+
+//////////////////////// _genieSendRead ////////////////////////
+//
+// Send a read object command, leaving the event queue alone. The
+// reply is read in due course by genieDoEvents().
+//
+// Returns:	TRUE if the command was sent
+//			FALSE if the display is down
+//
+bool _genieSendRead (uint8_t object, uint8_t index) {
+	uint8_t frame[4];
+
+	if (!_genieWaitForLink(GENIE_LINK_WF_RXREPORT))
+		return FALSE;
+
+	_genieError = ERROR_NONE;
+
+	frame[0] = GENIE_READ_OBJ;
+	frame[1] = object;
+	frame[2] = index;
+	frame[3] = frame[0] ^ frame[1] ^ frame[2];
+	_genieWrite(frame, 4);
+
+	return TRUE;
+}
+#endif
+
+///////////////////// _genieSetLinkState ////////////////////////
+//
+// Set the logical state of the link to the display.
+//
+// Parms:	uint16_t newstate, a value to be written to the 
+//				link's _genieLinkState variable. Valid values are
+//		GENIE_LINK_IDLE			0
+//		GENIE_LINK_WFAN			1 // waiting for Ack or Nak
+//		GENIE_LINK_WF_RXREPORT	2 // waiting for a report frame
+//		GENIE_LINK_RXREPORT		3 // receiving a report frame
+//		GENIE_LINK_RXEVENT		4 // receiving an event frame
+//		GENIE_LINK_SHDN			5
+//
+void _genieSetLinkState (uint16_t newstate) {
+	
+	*_genieLinkState = newstate;
+
+	if (newstate == GENIE_LINK_WFAN)
+		_genieAcksPending = 1;
+
+	if (newstate == GENIE_LINK_RXREPORT || \
+		newstate == GENIE_LINK_RXEVENT)
+		rxframe_count = 0;	
+}
+
+/////////////////////// _genieGetLinkState //////////////////////
+//
+// Get the current logical state of the link to the display.
+//
+uint16_t _genieGetLinkState (void) {
+	return *_genieLinkState;
+}
+
+///////////////////////// genieWriteObject //////////////////////
+//
+// Write data to an object on the display
+//
+uint16_t genieWriteObject (uint16_t object, uint16_t index, uint16_t data)
+{
+	_genieMirrorWrite(object, index, data);
+
+	if (!_genieWaitForLink(GENIE_LINK_WFAN))
+		return ERROR_NODISPLAY;
+
+	_genieError = ERROR_NONE;
+
+	_genieSendWriteObj(object, index, data);
+
+	return ERROR_NONE;
+}
+
+///////////////////////// _genieSendWriteObj ////////////////////
+//
+// Send a write object frame, the caller deals with the link state
+//
+void _genieSendWriteObj (uint8_t object, uint8_t index, uint16_t data)
+{
+	uint8_t frame[GENIE_FRAME_SIZE];
+
+	frame[0] = GENIE_WRITE_OBJ;
+	frame[1] = object;
+	frame[2] = index;
+	frame[3] = highByte(data);
+	frame[4] = lowByte(data);
+	frame[5] = frame[0] ^ frame[1] ^ frame[2] ^ frame[3] ^ frame[4];
+	_genieWrite(frame, GENIE_FRAME_SIZE);
+}
+
+/////////////////////// genieWriteContrast //////////////////////
+// 
+// Alter the display contrast (backlight)
+//
+// Parms:	uint8_t value: The required contrast setting, only
+//		values from 0 to 15 are valid. 0 or 1 for most displays
+//      and 0 to 15 for the uLCD-43
+//
+void genieWriteContrast (uint16_t value) {
+	uint8_t frame[3];
+
+	_genieContrast = value;
+
+	if (!_genieWaitForLink(GENIE_LINK_WFAN))
+		return;
+
+	frame[0] = GENIE_WRITE_CONTRAST;
+	frame[1] = value;
+	frame[2] = frame[0] ^ frame[1];
+	_genieWrite(frame, 3);
+
+}
+
+#ifndef GENIE_NO_STRINGS
+//////////////////////// _genieWriteStrX ///////////////////////
+//
+// Non-user function used by genieWriteStr() and genieWriteStrU()
+//
+static int _genieWriteStrX (uint16_t code, uint16_t index, char *string)
+{
+	int len = strlen (string) ;
+
+	if (len > 255)
+	return -1 ;
+
+	_genieMirrorStr(code, index, string, len);
+
+	if (!_genieWaitForLink(GENIE_LINK_WFAN))
+		return ERROR_NODISPLAY;
+
+	_genieSendStr(code, index, string, len);
+
+	return 0 ;
+}
+
+//////////////////////////////////////////////////////////////
+// A string frame being sent. On a Stream it is built in buf and
+// goes to the display in one _genieWrite() when it is finished, 
+// or each time buf fills for a long string. On a serial port buf
+// is NULL and each character is written as it is added.
+//
+struct genieTxStruct {
+	uint8_t *	buf;
+	uint8_t		len;
+	uint8_t		checksum;
+};
+
+//////////////////////// _genieTxAdd //////////////////////////////
+//
+static void _genieTxAdd (genieTxStruct * tx, uint8_t c) {
+	tx->checksum ^= c;
+	if (tx->buf == NULL) {
+		_geniePutchar(c);
+		return;
+	}
+	if (tx->len == GENIE_TX_CHUNK) {
+		_genieWrite(tx->buf, tx->len);
+		tx->len = 0;
+	}
+	tx->buf[tx->len++] = c;
+}
+
+//////////////////////// _genieTxStart ////////////////////////////
+//
+static void _genieTxStart (genieTxStruct * tx, uint8_t code, uint8_t index, uint8_t len) {
+	tx->len = 0;
+	tx->checksum = 0;
+	_genieTxAdd(tx, code);
+	_genieTxAdd(tx, index);
+	_genieTxAdd(tx, len);
+}
+
+//////////////////////// _genieTxEnd //////////////////////////////
+//
+// Add the checksum and send what is left
+//
+static void _genieTxEnd (genieTxStruct * tx) {
+	_genieTxAdd(tx, tx->checksum);
+	if (tx->buf != NULL)
+		_genieWrite(tx->buf, tx->len);
+}
+
+/////////////////////// genieWriteStr ////////////////////////
+//
+// Write a string to the display (ASCII)
+//
+uint16_t genieWriteStr (uint16_t index, char *string) {
+ 
+  return _genieWriteStrX (GENIE_WRITE_STR, index, string);
+
+}
 
-//////////////////////// genieReadObject ///////////////////////
+/////////////////////// genieWriteStrU ////////////////////////
 //
-// Send a read object command to the Genie display. Note that this 
-// function does not wait for the reply, that will be read in due 
-// course by genieDoEvents() and subsequently by the user's event 
-// handler.
+// Write a string to the display (Unicode)
 //
-bool genieReadObject (uint16_t object, uint16_t index) {
+uint16_t genieWriteStrU (uint16_t index, char *string) {
 
-	uint8_t checksum;
+  return _genieWriteStrX (GENIE_WRITE_STRU, index, string);
 
-	_genieFlushEventQueue();	// Discard any pending reply frames
+}
 
-	_genieWaitForIdle();
+//////////////////////////////////////////////////////////////
+// Where the output of _genieFormat() goes
+//
+struct genieFormatStruct {
+	char *		buf;		// a copy of the output, NULL if not wanted
+	uint8_t		size;		// room in buf
+	genieTxStruct *	tx;		// the frame to send the output in, NULL if not sent
+	uint16_t	len;		// number of characters output
+};
 
-	_genieError = ERROR_NONE;
+//////////////////////// _genieFormatChar /////////////////////////
+//
+static void _genieFormatChar (genieFormatStruct * out, char c) {
+	if (out->tx != NULL)
+		_genieTxAdd(out->tx, c);
+	if (out->buf != NULL && out->len < out->size)
+		out->buf[out->len] = c;
+	out->len++;
+}
+
+//////////////////////// _genieFormat /////////////////////////////
+//
+// A small printf() for genieWriteStrf() that outputs one character
+// at a time, so nothing needs to be buffered. It understands
+//
+//	%d %i %u %x %X %c %s %%
+//
+// with the flags - (left justify), 0 (zero fill), + and space (sign
+// of a positive number), a field width of up to 255 and h, hh or l 
+// for a short, char or long argument. Anything else, eg a precision,
+// * or %f, is rejected before any argument is taken.
+//
+// Returns:	FALSE if fmt has a conversion that isn't understood, 
+//			what was output before it is left in out
+//
+static bool _genieFormat (genieFormatStruct * out, const char * fmt, va_list args) {
+	char digits[sizeof(unsigned long) * CHAR_BIT / 3 + 2];	// every digit of an unsigned long
+	const char * str;
+	unsigned long v;
+	uint16_t n, pad, i, width;
+	uint8_t base, shorts;
+	bool left, zero, is_long;
+	char c, sign, plus;
+
+	while ((c = *fmt++) != 0) {
+		if (c != '%') {
+			_genieFormatChar(out, c);
+			continue;
+		}
+
+		left = zero = is_long = FALSE;
+		plus = 0;
+		for (;; fmt++) {
+			if (*fmt == '-')
+				left = TRUE;
+			else if (*fmt == '0')
+				zero = TRUE;
+			else if (*fmt == '+')
+				plus = '+';
+			else if (*fmt == ' ') {
+				if (plus == 0)
+					plus = ' ';
+			} else
+				break;
+		}
+		for (width = 0; *fmt >= '0' && *fmt <= '9'; fmt++) {
+			width = width * 10 + *fmt - '0';
+			if (width > 255)
+				return FALSE;
+		}
+		for (shorts = 0; *fmt == 'h' && shorts < 2; fmt++)
+			shorts++;
+		if (*fmt == 'l' && shorts == 0) {
+			is_long = TRUE;
+			fmt++;
+		}
 
-	_geniePutchar(GENIE_READ_OBJ); checksum   = GENIE_READ_OBJ ;
-	_geniePutchar(object);         checksum  ^= object ;
-	_geniePutchar(index);          checksum  ^= index ;
-	_geniePutchar(checksum);
+		n = 0;
+		str = digits;
+		base = 10;
+		sign = 0;
+		switch (c = *fmt++) {
+			case 'd':
+			case 'i': {
+				long sv = is_long ? va_arg(args, long) : va_arg(args, int);
+				if (shorts == 1)
+					sv = (short)sv;
+				else if (shorts == 2)
+					sv = (signed char)sv;
+				v = (sv < 0) ? -(unsigned long)sv : sv;
+				sign = (sv < 0) ? '-' : plus;
+				break;
+			}
+			case 'x':
+			case 'X':
+				base = 16;
+				// fall through
+			case 'u':
+				v = is_long ? va_arg(args, unsigned long) : va_arg(args, unsigned int);
+				if (shorts == 1)
+					v = (unsigned short)v;
+				else if (shorts == 2)
+					v = (unsigned char)v;
+				break;
+			case 'c':
+				digits[n++] = va_arg(args, int);
+				break;
+			case 's':
+				str = va_arg(args, const char *);
+				if (str == NULL)
+					str = "";
+				n = strlen(str);
+				break;
+			case '%':
+				digits[n++] = '%';
+				break;
+			default:
+				return FALSE;
+		}
 
-	_geniePushLinkState(GENIE_LINK_WF_RXREPORT);
+		// numbers are built backwards then reversed
+		if (str == digits && n == 0) {
+			do {
+				uint8_t d = v % base;
+				digits[n++] = (d < 10) ? '0' + d : ((c == 'X') ? 'A' : 'a') + d - 10;
+				v /= base;
+			} while (v != 0);
+			for (i = 0; i < n / 2; i++) {
+				char t = digits[i];
+				digits[i] = digits[n - 1 - i];
+				digits[n - 1 - i] = t;
+			}
+		}
 
+		pad = (width > n + (sign != 0)) ? width - n - (sign != 0) : 0;
+		if (!left && !zero)
+			for (; pad > 0; pad--)
+				_genieFormatChar(out, ' ');
+		if (sign != 0)
+			_genieFormatChar(out, sign);
+		if (!left)
+			for (; pad > 0; pad--)
+				_genieFormatChar(out, '0');
+		for (i = 0; i < n; i++)
+			_genieFormatChar(out, str[i]);
+		for (; pad > 0; pad--)
+			_genieFormatChar(out, ' ');
+	}
 	return TRUE;
 }
 
-
-///////////////////// _genieSetLinkState ////////////////////////
+//////////////////////// _genieTxStr /////////////////////////////
 //
-// Set the logical state of the link to the display.
+// Send a write string frame in tx holding string, or if it is NULL
+// fmt formatted with args through out
 //
-// Parms:	uint16_t newstate, a value to be written to the 
-//				link's _genieLinkState variable. Valid values are
-//		GENIE_LINK_IDLE			0
-//		GENIE_LINK_WFAN			1 // waiting for Ack or Nak
-//		GENIE_LINK_WF_RXREPORT	2 // waiting for a report frame
-//		GENIE_LINK_RXREPORT		3 // receiving a report frame
-//		GENIE_LINK_RXEVENT		4 // receiving an event frame
-//		GENIE_LINK_SHDN			5
+static void _genieTxStr (genieTxStruct * tx, genieFormatStruct * out, uint8_t code, uint8_t index,
+						 const char * string, uint8_t len, const char * fmt, va_list * args) {
+	uint8_t i;
+
+	_genieTxStart(tx, code, index, len);
+	if (string != NULL) {
+		for (i = 0; i < len; i++)
+			_genieTxAdd(tx, string[i]);
+	} else {
+		out->tx = tx;
+		out->len = 0;
+		_genieFormat(out, fmt, *args);
+		out->tx = NULL;
+	}
+	_genieTxEnd(tx);
+}
+
+//////////////////////// _genieTxStrBuffered /////////////////////
 //
-void _genieSetLinkState (uint16_t newstate) {
-	
-	*_genieLinkState = newstate;
+// _genieTxStr() for a Stream. Kept out of line so the buffer is 
+// only on the stack while a Stream is being written to.
+//
+static void __attribute__((noinline)) _genieTxStrBuffered (genieFormatStruct * out, uint8_t code, uint8_t index,
+						 const char * string, uint8_t len, const char * fmt, va_list * args) {
+	uint8_t buf[GENIE_TX_CHUNK];
+	genieTxStruct tx;
 
-	if (newstate == GENIE_LINK_RXREPORT || \
-		newstate == GENIE_LINK_RXEVENT)
-		rxframe_count = 0;	
+	tx.buf = buf;
+	_genieTxStr(&tx, out, code, index, string, len, fmt, args);
 }
 
-/////////////////////// _genieGetLinkState //////////////////////
+//////////////////////// _genieSendStrFrame //////////////////////
 //
-// Get the current logical state of the link to the display.
+// Send a write string frame, see _genieTxStr(). The caller deals 
+// with the link state.
 //
-uint16_t _genieGetLinkState (void) {
-	return *_genieLinkState;
+static void _genieSendStrFrame (genieFormatStruct * out, uint8_t code, uint8_t index,
+						 const char * string, uint8_t len, const char * fmt, va_list * args) {
+	genieTxStruct tx;
+
+	if (_genieStream != NULL) {
+		_genieTxStrBuffered(out, code, index, string, len, fmt, args);
+		return;
+	}
+	tx.buf = NULL;
+	_genieTxStr(&tx, out, code, index, string, len, fmt, args);
 }
 
-///////////////////////// genieWriteObject //////////////////////
+//////////////////////// _genieSendStr ///////////////////////////
 //
-// Write data to an object on the display
+// Send a write string frame, the caller deals with the link state
 //
-uint16_t genieWriteObject (uint16_t object, uint16_t index, uint16_t data)
+void _genieSendStr (uint8_t code, uint8_t index, const char * string, uint8_t len)
 {
-	uint16_t msb, lsb ;
-	uint8_t checksum ;
+	_genieSendStrFrame(NULL, code, index, string, len, NULL, NULL);
+}
+/////////////////////// genieWriteStrf ///////////////////////
+//
+// Write a printf() style formatted string to the display (ASCII),
+// eg
+//
+//	genieWriteStrf(0, "%3d%%", level);
+//
+// The string is formatted twice, once to find its length and then 
+// straight into the frame, and the mirror if it is short enough, so
+// only the frame buffer is needed. See _genieFormat() for the 
+// conversions understood.
+//
+// Returns:	0 if the string was sent
+//			-1 if it is longer than 255 characters or fmt has a 
+//			conversion that isn't understood, nothing is sent
+//			ERROR_NODISPLAY if the display is down
+//
+uint16_t genieWriteStrf (uint16_t index, const char * fmt, ...) {
+	genieFormatStruct out;
+	va_list args, pass;
+	bool ok;
 
-	_genieWaitForIdle();
+	memset(&out, 0, sizeof(out));
+	va_start(args, fmt);
+	va_copy(pass, args);
+	ok = _genieFormat(&out, fmt, pass);
+	va_end(pass);
 
-	lsb = lowByte(data);
-	msb = highByte(data);
+	if (!ok || out.len > 255) {
+		va_end(args);
+		return -1;
+	}
 
-	_genieError = ERROR_NONE;
+	// the second pass fills in the mirror as it goes, or only the
+	// mirror if the display is down
+	out.size = out.len;
+	if (!_genieWaitForLink(GENIE_LINK_WFAN)) {
+		out.buf = _genieMirrorStrText(GENIE_WRITE_STR, index, out.size);
+		if (out.buf != NULL) {
+			out.len = 0;
+			_genieFormat(&out, fmt, args);
+		}
+		va_end(args);
+		return ERROR_NODISPLAY;
+	}
 
-	_geniePutchar(GENIE_WRITE_OBJ) ; checksum  = GENIE_WRITE_OBJ ;
-	_geniePutchar(object) ;          checksum ^= object ;
-	_geniePutchar(index) ;           checksum ^= index ;
-	_geniePutchar(msb) ;             checksum ^= msb;
-	_geniePutchar(lsb) ;             checksum ^= lsb;
-	_geniePutchar(checksum) ;
+	out.buf = _genieMirrorStrText(GENIE_WRITE_STR, index, out.size);
+	_genieSendStrFrame(&out, GENIE_WRITE_STR, index, NULL, out.size, fmt, &args);
+	va_end(args);
 
-	_geniePushLinkState(GENIE_LINK_WFAN);
-	
+	return 0;
 }
+#endif
 
-/////////////////////// genieWriteContrast //////////////////////
-// 
-// Alter the display contrast (backlight)
+#ifdef GENIE_COMMAND_QUEUE
+//////////////////////////////////////////////////////////////
+// Commands submitted by other threads, a bounded lock-free 
+// queue. Each slot's sequence number says whether it is free 
+// for the producer at that position or full for the consumer.
+//
+static genieCommandQueueStruct _genieCommandQueue;
+static bool _genieCommandQueueReady = FALSE;
+#ifdef GENIE_QUEUE_STATS
+// the producers only touch overflows, the rest is the link thread's
+static genieQueueStatsStruct _genieCommandStats;
+#endif
+
+////////////////////// _genieInitCommandQueue //////////////////
 //
-// Parms:	uint8_t value: The required contrast setting, only
-//		values from 0 to 15 are valid. 0 or 1 for most displays
-//      and 0 to 15 for the uLCD-43
+// Called from genieBegin() before any other thread can submit.
 //
-void genieWriteContrast (uint16_t value) {
-	unsigned int checksum ;
+void _genieInitCommandQueue (void) {
+	uint32_t i;
 
-	_genieWaitForIdle();
+	for (i = 0; i < MAX_GENIE_COMMANDS; i++)
+		__atomic_store_n(&_genieCommandQueue.slots[i].seq, i, __ATOMIC_RELAXED);
+	__atomic_store_n(&_genieCommandQueue.wr_pos, 0, __ATOMIC_RELAXED);
+	_genieCommandQueue.rd_pos = 0;
+	__atomic_store_n(&_genieCommandQueueReady, TRUE, __ATOMIC_RELEASE);
+}
+
+////////////////////// genieSubmitCommand ///////////////////////
+//
+// Queue a command to be sent by the link thread, may be called 
+// from any thread.
+//
+// Parms:	uint8_t cmd, GENIE_READ_OBJ, GENIE_WRITE_OBJ, GENIE_WRITE_STR,
+//				GENIE_WRITE_STRU or GENIE_WRITE_CONTRAST
+//			uint16_t object, uint16_t index, uint16_t data, the 
+//				command's parameters, the contrast value is in data
+//			const char * string, the string for a string write, it 
+//				is copied so it need not outlive the call
+//			genieCompletionPtr done, called when the command has 
+//				finished, may be NULL
+//			void * arg, passed to done
+//
+// Returns:	TRUE if the command was queued
+//			FALSE if the queue is full, genieBegin() hasn't been 
+//				called or the string is too long
+//
+bool genieSubmitCommand (uint8_t cmd, uint16_t object, uint16_t index, uint16_t data,
+						 const char * string, genieCompletionPtr done, void * arg) {
+	genieCommandStruct * slot;
+	uint32_t pos, seq;
+	int32_t diff;
+
+	if (!__atomic_load_n(&_genieCommandQueueReady, __ATOMIC_ACQUIRE))
+		return FALSE;
+
+	if (cmd == GENIE_WRITE_STR || cmd == GENIE_WRITE_STRU) {
+#ifdef GENIE_NO_STRINGS
+		return FALSE;
+#else
+		if (string == NULL || strlen(string) > MAX_GENIE_CMD_STR)
+			return FALSE;
+#endif
+	}
+
+	// claim a slot by advancing the write position
+	pos = __atomic_load_n(&_genieCommandQueue.wr_pos, __ATOMIC_RELAXED);
+	for (;;) {
+		slot = &_genieCommandQueue.slots[pos & (MAX_GENIE_COMMANDS -1)];
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		diff = (int32_t)(seq - pos);
 
-	_geniePutchar(GENIE_WRITE_CONTRAST) ; checksum  = GENIE_WRITE_CONTRAST ;
-	_geniePutchar(value) ;                checksum ^= value ;
-	_geniePutchar(checksum) ;
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&_genieCommandQueue.wr_pos, &pos, pos + 1,
+					TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if (diff < 0) {
+#ifdef GENIE_QUEUE_STATS
+			__atomic_fetch_add(&_genieCommandStats.overflows, 1, __ATOMIC_RELAXED);
+#endif
+			return FALSE;	// full
+		} else {
+			pos = __atomic_load_n(&_genieCommandQueue.wr_pos, __ATOMIC_RELAXED);
+		}
+	}
 
-	_geniePushLinkState(GENIE_LINK_WFAN);
+	slot->cmd		= cmd;
+	slot->object	= object;
+	slot->index		= index;
+	slot->data		= data;
+	slot->done		= done;
+	slot->arg		= arg;
+#ifndef GENIE_NO_STRINGS
+	if (cmd == GENIE_WRITE_STR || cmd == GENIE_WRITE_STRU)
+		strcpy(slot->string, string);
+#endif
 
+	// hand the slot to the link thread
+	__atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+	return TRUE;
 }
 
-//////////////////////// _genieWriteStrX ///////////////////////
+////////////////////// genieServiceCommands /////////////////////
 //
-// Non-user function used by genieWriteStr() and genieWriteStrU()
+// Run the commands queued by genieSubmitCommand() and then 
+// genieDoEvents(). Only the link thread may call this, or any 
+// other genie function apart from genieSubmitCommand().
 //
-static int _genieWriteStrX (uint16_t code, uint16_t index, char *string)
-{
-	char *p ;
-	unsigned int checksum ;
-	int len = strlen (string) ;
+// Each command waits for the display's reply so its result can
+// be passed to the completion function.
+//
+// Returns:	The number of commands run
+//
+uint16_t genieServiceCommands (void) {
+	genieCommandStruct * slot;
+	uint16_t n = 0;
+	uint16_t value;
+	int16_t result;
 
-	if (len > 255)
-	return -1 ;
+	for (;;) {
+#ifdef GENIE_QUEUE_STATS
+		// only this thread empties the queue so it is never fuller
+		// than it is here
+		_genieQueueLevel(&_genieCommandStats, 
+			__atomic_load_n(&_genieCommandQueue.wr_pos, __ATOMIC_RELAXED) - _genieCommandQueue.rd_pos);
+#endif
+		slot = &_genieCommandQueue.slots[_genieCommandQueue.rd_pos & (MAX_GENIE_COMMANDS -1)];
+		if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != _genieCommandQueue.rd_pos + 1)
+			break;
+#ifdef GENIE_QUEUE_STATS
+		_genieCommandStats.queued++;
+#endif
 
-	_genieWaitForIdle();
+		value = 0;
+		result = ERROR_NONE;
+		_genieReplyError = ERROR_NONE;
+
+		switch (slot->cmd) {
+			case GENIE_READ_OBJ:
+				// sent with _genieSendRead(), the link thread's queued
+				// events are left alone
+				if (!genieReadCachedObject(slot->object, slot->index, 0, &value))
+					result = _genieDown(_genieTxDisplay) ? ERROR_NODISPLAY : ERROR_TIMEOUT;
+				break;
+
+			case GENIE_WRITE_OBJ:
+				result = genieWriteObject(slot->object, slot->index, slot->data);
+				break;
+
+#ifndef GENIE_NO_STRINGS
+			case GENIE_WRITE_STR:
+			case GENIE_WRITE_STRU:
+				result = _genieWriteStrX(slot->cmd, slot->index, slot->string);
+				break;
+#endif
+
+			case GENIE_WRITE_CONTRAST:
+				genieWriteContrast(slot->data);
+				if (_genieDown(_genieTxDisplay))
+					result = ERROR_NODISPLAY;
+				break;
+
+			default:
+				result = ERROR_NAK;
+				break;
+		}
+
+		// wait for the ACK so the result is known
+		if (result == ERROR_NONE && slot->cmd != GENIE_READ_OBJ) {
+			_genieWaitForIdle();
+			result = _genieReplyError;
+		}
+
+		if (slot->done != NULL)
+			(slot->done)(slot->arg, result, value);
 
-	_geniePutchar(code) ;               checksum  = code ;
-	_geniePutchar(index) ;              checksum ^= index ;
-	_geniePutchar((unsigned char)len) ; checksum ^= len ;
-	for (p = string ; *p ; ++p)	{
-		_geniePutchar (*p) ;
-		checksum ^= *p ;
+		// free the slot for the producer one lap ahead
+		__atomic_store_n(&slot->seq, _genieCommandQueue.rd_pos + MAX_GENIE_COMMANDS, 
+						 __ATOMIC_RELEASE);
+		_genieCommandQueue.rd_pos++;
+		n++;
 	}
-	_geniePutchar(checksum) ;
 
-	_geniePushLinkState(GENIE_LINK_WFAN);
+	genieDoEvents();
+	return n;
+}
+#endif
+
+#ifdef GENIE_QUEUE_STATS
+////////////////////// _genieQueueLevel /////////////////////////
+//
+// Record the number of entries a queue now holds.
+//
+void _genieQueueLevel (genieQueueStatsStruct * stats, uint8_t level) {
+	bool was_above = stats->level > _genieQueueThreshold;
+	bool is_above = level > _genieQueueThreshold;
 
-	return 0 ;
+	if (is_above && !was_above)
+		stats->above_since = millis();
+	else if (was_above && !is_above)
+		stats->above_ms += millis() - stats->above_since;
+
+	if (level > stats->high_water)
+		stats->high_water = level;
+	stats->level = level;
 }
 
-/////////////////////// genieWriteStr ////////////////////////
+#ifndef GENIE_WRITE_ONLY
+////////////////////// _genieCopyQueueStats /////////////////////
 //
-// Write a string to the display (ASCII)
+// Copy a queue's statistics, counting the time it has been above
+// the threshold so far if it still is.
 //
-uint16_t genieWriteStr (uint16_t index, char *string) {
- 
-  return _genieWriteStrX (GENIE_WRITE_STR, index, string);
+static void _genieCopyQueueStats (genieQueueStatsStruct * to, genieQueueStatsStruct * from) {
+	*to = *from;
+	to->threshold = _genieQueueThreshold;
+	if (to->level > _genieQueueThreshold)
+		to->above_ms += millis() - to->above_since;
+}
+
+////////////////////// _genieClearQueueStats ////////////////////
+//
+static void _genieClearQueueStats (genieQueueStatsStruct * stats) {
+	stats->above_ms = 0;
+	stats->above_since = millis();
+	stats->queued = 0;
+	stats->high_water = stats->level;
+}
 
+////////////////////// genieGetQueueStats ///////////////////////
+//
+// Copy the event queue's statistics, with GENIE_MULTIDROP those 
+// of the selected display's queue.
+//
+// Parms:	genieQueueStatsStruct * stats, set to the statistics
+//
+void genieGetQueueStats (genieQueueStatsStruct * stats) {
+	GENIE_LOCK();
+	_genieCopyQueueStats(stats, &_genieEventQueues[_genieTxDisplay].stats);
+	GENIE_UNLOCK();
 }
+#endif
 
-/////////////////////// genieWriteStrU ////////////////////////
+#ifdef GENIE_COMMAND_QUEUE
+////////////////////// genieGetCommandQueueStats ////////////////
 //
-// Write a string to the display (Unicode)
+// Copy the command queue's statistics, the level is as last seen
+// by genieServiceCommands(). Only the link thread may call this.
 //
-uint16_t genieWriteStrU (uint16_t index, char *string) {
+// Parms:	genieQueueStatsStruct * stats, set to the statistics
+//
+void genieGetCommandQueueStats (genieQueueStatsStruct * stats) {
+	_genieCopyQueueStats(stats, &_genieCommandStats);
+	stats->overflows = __atomic_load_n(&_genieCommandStats.overflows, __ATOMIC_RELAXED);
+}
+#endif
 
-  return _genieWriteStrX (GENIE_WRITE_STRU, index, string);
+////////////////////// genieResetQueueStats /////////////////////
+//
+// Start the statistics of all the queues again, the high water 
+// marks start from what each queue holds now.
+//
+void genieResetQueueStats (void) {
+#ifndef GENIE_WRITE_ONLY
+	genieEventQueueStruct * q;
+
+	GENIE_LOCK();
+	for (q = _genieEventQueues; 
+		 q < &_genieEventQueues[sizeof(_genieEventQueues) / sizeof(_genieEventQueues[0])]; q++) {
+		_genieClearQueueStats(&q->stats);
+		q->stats.overflows = 0;
+	}
+	GENIE_UNLOCK();
+#endif
+#ifdef GENIE_COMMAND_QUEUE
+	_genieClearQueueStats(&_genieCommandStats);
+	__atomic_store_n(&_genieCommandStats.overflows, 0, __ATOMIC_RELAXED);
+#endif
+}
 
+////////////////////// genieSetQueueThreshold ///////////////////
+//
+// Set the number of entries a queue must hold more than to be 
+// counted as above the threshold, for all the queues. The 
+// statistics are reset.
+//
+void genieSetQueueThreshold (uint8_t threshold) {
+	GENIE_LOCK();
+	_genieQueueThreshold = threshold;
+	GENIE_UNLOCK();
+	genieResetQueueStats();
 }
+#endif
 
+#ifndef GENIE_WRITE_ONLY
 /////////////////// genieAttachEventHandler //////////////////////
 //
 // "Attaches" a pointer to the users event handler by writing 
@@ -619,6 +2709,7 @@ uint16_t genieWriteStrU (uint16_t index, char *string) {
 void genieAttachEventHandler (genieUserEventHandlerPtr handler) {
 	_genieUserHandler = handler;
 }
+#endif
 
 //////////////////////// _genieGetchar //////////////////////////
 //
@@ -643,61 +2734,97 @@ uint8_t _genieGetchar() {
 	return (_genieGetCharHandler)();
 }
 
+#ifdef SERIAL
 ///////////////////////////////////////////////////////////////////
 // Serial port 0 (Serial) Rx  handler
 // Return ERROR_NOCHAR if no character or the char in the lower
 // byte if there is.
 //
 uint16_t _genieGetchar_Serial (void) {
-#ifdef SERIAL
 	if (Serial.available() == 0) {
 		_genieError = ERROR_NOCHAR;
 		return ERROR_NOCHAR;  
 	}	
 	return (uint16_t) Serial.read() & 0xFF;
-#endif
 }
+#endif
+#ifdef SERIAL_1
 ///////////////////////////////////////////////////////////////////
 // Serial port 1 (Serial1) Rx  handler
 // Return ERROR_NOCHAR if no character or the char in the lower
 // byte if there is.
 //
 uint16_t _genieGetchar_Serial1 (void) {
-#ifdef SERIAL_1
 	if (Serial1.available() == 0) {
 		_genieError = ERROR_NOCHAR;
 		return ERROR_NOCHAR;  
 	}
 	return (uint16_t) Serial1.read() & 0xFF;
-#endif
 }
+#endif
+#ifdef SERIAL_2
 ///////////////////////////////////////////////////////////////////
 // Serial port 2 (Serial2) Rx  handler
 // Return ERROR_NOCHAR if no character or the char in the lower
 // byte if there is.
 //
 uint16_t _genieGetchar_Serial2 (void) {
-#ifdef SERIAL_2
 	if (Serial2.available() == 0) {
 		_genieError = ERROR_NOCHAR;
 		return ERROR_NOCHAR;  
 	}
 	return (uint16_t) Serial2.read() & 0xFF;
-#endif
 }
+#endif
+#ifdef SERIAL_3
 ///////////////////////////////////////////////////////////////////
 // Serial port 3 (Serial3) Rx  handler
 // Return ERROR_NOCHAR if no character or the char in the lower
 // byte if there is.
 //
 uint16_t _genieGetchar_Serial3 (void) {
-#ifdef SERIAL_3
 	if (Serial3.available() == 0) {
 		_genieError = ERROR_NOCHAR;
 		return ERROR_NOCHAR;  
 	}
 	return (uint16_t) Serial3.read() & 0xFF;
+}
 #endif
+///////////////////////////////////////////////////////////////////
+// Stream Rx handler
+// Return ERROR_NOCHAR if no character or the char in the lower
+// byte if there is.
+//
+uint16_t _genieGetchar_Stream (void) {
+	if (_genieStream->available() <= 0) {
+		_genieError = ERROR_NOCHAR;
+		return ERROR_NOCHAR;
+	}
+	return (uint16_t) _genieStream->read() & 0xFF;
+}
+
+/////////////////////// _genieRxStream //////////////////////////
+//
+// Read everything waiting in the Stream, up to GENIE_RX_CHUNK 
+// characters, and pass it to genieRxByte()
+//
+// Returns:	The number of characters read
+//
+uint8_t _genieRxStream (void) {
+	uint8_t buf[GENIE_RX_CHUNK];
+	int n;
+
+	n = _genieStream->available();
+	if (n <= 0)
+		return 0;
+	if (n > GENIE_RX_CHUNK)
+		n = GENIE_RX_CHUNK;
+
+	// only what is already there, so this doesn't wait
+	n = _genieStream->readBytes((char *)buf, n);
+	for (int i = 0; i < n; i++)
+		genieRxByte(buf[i]);
+	return n;
 }
 
 /////////////////////// _geniePutchar ///////////////////////////
@@ -710,49 +2837,73 @@ void _geniePutchar (uint8_t c) {
 		(_geniePutCharHandler)(c, 0);
 }
 
+/////////////////////// _genieWrite /////////////////////////////
+//
+// Output a number of characters to the Genie display, all in one
+// go if the link is a Stream. Every frame is sent with one call, 
+// on a Stream strings longer than GENIE_TX_CHUNK - 4 characters 
+// with one per GENIE_TX_CHUNK.
+//
+void _genieWrite (const uint8_t * buf, uint8_t len) {
+	if (_genieStream != NULL) {
+		_genieStream->write(buf, len);
+		return;
+	}
+	while (len--)
+		_geniePutchar(*buf++);
+}
+
+///////////////////////////////////////////////////////////////////
+// Stream Tx handler, the Stream is set up by the caller so there
+// is no init
+void _geniePutchar_Stream (uint8_t c, uint32_t baud) {
+	if (baud == 0)
+		_genieStream->write(c);
+}
+
+#ifdef SERIAL
 ///////////////////////////////////////////////////////////////////
 // Serial port 0 (Serial) Tx and init  handler
 void _geniePutchar_Serial (uint8_t c, uint32_t baud) {
-#ifdef SERIAL
   if (baud != 0)
     Serial.begin (baud);
   else
     Serial.write (c);
+}
 #endif
-} 
 
+#ifdef SERIAL_1
 ///////////////////////////////////////////////////////////////////
 // Serial port 1 (Serial1) Tx and init  handler
 void _geniePutchar_Serial1 (uint8_t c, uint32_t baud) {
-#ifdef SERIAL_1
 	if (baud != 0)
 		Serial1.begin (baud);
 	else
 		Serial1.write (c);
-#endif
 }
+#endif
 
+#ifdef SERIAL_2
 ///////////////////////////////////////////////////////////////////
 // Serial port 2 (Serial2) Tx and init  handler
 void _geniePutchar_Serial2 (uint8_t c, uint32_t baud) {
-#ifdef SERIAL_2
 	if (baud != 0)
 	    Serial2.begin (baud);
 	else
 		Serial2.write (c);
-#endif
 }
+#endif
 
+#ifdef SERIAL_3
 ///////////////////////////////////////////////////////////////////
 // Serial port 3 (Serial3) Tx and init  handler
 void _geniePutchar_Serial3 (uint8_t c, uint32_t baud) {
-#ifdef SERIAL_3
 	if (baud != 0)
 		Serial3.begin (baud);
 	else
 		Serial3.write (c);
-#endif
 }
+#endif
 
 //////////////////////////////////// genieSetup /////////////////////////////////////////
 //
@@ -790,13 +2941,53 @@ uint16_t genieBegin (uint8_t port, uint32_t baud) {
 			// bad serial port 
 			return false;
 	}
+	// not built for this port
+	if (_geniePutCharFuncTable[port] == NULL)
+		return false;
+
+	_genieStream = NULL;
 	_geniePutCharHandler = _geniePutCharFuncTable[port];
 	_genieGetCharHandler = _genieGetCharFuncTable[port];
 	(_geniePutCharHandler)(GENIE_NULL, baud);
-	_geniePushLinkState(GENIE_LINK_IDLE);
-	
-	_genieFlushEventQueue();
+	_genieStartLink();
+
+	return true;
+}
+
+/////////////////////////////////// genieBegin ///////////////////////////////////////////
+// 
+//	boolean genieBegin (Stream & stream) 
+//
+//	Stream & stream:	Any Arduino Stream already set up by the caller, eg
+//						SerialUSB, a SoftwareSerial or a remapped port. Many
+//						characters are moved per call where the Stream allows.
+//
+//	Returns:		True
+//
+uint16_t genieBegin (Stream & stream) {
+
+	_genieStream = &stream;
+	_geniePutCharHandler = _geniePutchar_Stream;
+	_genieGetCharHandler = _genieGetchar_Stream;
+	_genieStartLink();
 
 	return true;
 }
 
+/////////////////////////////////// _genieStartLink //////////////////////////////////////
+// 
+//	Start from scratch on the port or Stream just selected
+//
+void _genieStartLink (void) {
+
+	_genieResetLinkState();
+
+	_genieFlushEventQueue();
+	_genieFlushCache();
+	_genieFlushMirror();
+	_genieLastActivity = millis();
+#ifdef GENIE_COMMAND_QUEUE
+	_genieInitCommandQueue();
+#endif
+}
+
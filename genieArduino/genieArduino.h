@@ -34,6 +34,113 @@
 
 #undef	GENIE_DEBUG
 
+// Define to build the multi-producer command queue, for RTOS and 
+// host builds where several threads update the display
+//#define	GENIE_COMMAND_QUEUE
+
+// Define to receive characters from the display in an interrupt, see
+// genieRxInterrupt(), instead of in genieDoEvents()
+//#define	GENIE_RX_INTERRUPT
+
+// Define to time stamp received frames and keep latency statistics
+//#define	GENIE_EVENT_TIMESTAMPS
+
+// Define to keep statistics of how full the event and command queues get
+//#define	GENIE_QUEUE_STATS
+
+// Define to drive several displays on one serial bus, see Multidrop
+//#define	GENIE_MULTIDROP
+
+//////////////////////////////////////////////////////////////////
+//
+// The options and table sizes must be the same for the library and
+// the sketch, the library is compiled on its own. Set them in this
+// file, in a genieConfig.h beside it or with compiler flags for the
+// whole build, never with #defines in the sketch ahead of the 
+// #include. tools/genieProjectGen.py --config writes a genieConfig.h
+// with the tables sized for a Workshop4 project.
+//
+#ifdef __has_include
+#if __has_include("genieConfig.h")
+#include "genieConfig.h"
+#endif
+#endif
+
+//////////////////////////////////////////////////////////////////
+//
+// Build options to cut the library down for small processors, 
+// define a profile or any of the individual options
+//
+//	GENIE_PROFILE_MINIMAL	Write only, no strings, Serial only and
+//							none of the optional tables
+//	GENIE_PROFILE_SMALL		Events with an 8 deep queue but none of 
+//							the optional tables or the link monitor
+//
+//	GENIE_WRITE_ONLY		Nothing but ACKs are used from the display, 
+//							no events, reads, filters or cache
+//	GENIE_NO_STRINGS		No genieWriteStr() or genieWriteStrU()
+//	GENIE_NO_LINK_MONITOR	No heartbeat, and the display is never 
+//							declared down
+//	GENIE_SINGLE_PORT n		Only support Serial (0) or Serial1-3 (1-3)
+//	MAX_GENIE_EVENTS n		Depth of the event queue
+//
+// The optional tables take SRAM and are left out unless a size is
+// given for them, eg by a genieConfig.h:
+//
+//	MAX_GENIE_FILTERS n		Event filters
+//	MAX_GENIE_CACHE n		Value cache, 8 by default with 
+//							GENIE_COMMAND_QUEUE which needs it
+//	MAX_GENIE_MIRROR n		State mirror, without it genieRestoreState()
+//							is not available
+//
+// The profiles leave them out even if a size is given.
+//
+// tools/genieSizeReport.sh prints the size of each profile.
+//
+#ifdef GENIE_PROFILE_MINIMAL
+#define	GENIE_WRITE_ONLY
+#define	GENIE_NO_STRINGS
+#define	GENIE_NO_LINK_MONITOR
+#define	GENIE_SINGLE_PORT	0
+#undef	MAX_GENIE_MIRROR
+#define	MAX_GENIE_MIRROR	0
+#endif
+
+#ifdef GENIE_PROFILE_SMALL
+#define	GENIE_NO_LINK_MONITOR
+#undef	MAX_GENIE_EVENTS
+#define	MAX_GENIE_EVENTS	8
+#undef	MAX_GENIE_FILTERS
+#define	MAX_GENIE_FILTERS	0
+#undef	MAX_GENIE_CACHE
+#define	MAX_GENIE_CACHE		0
+#undef	MAX_GENIE_MIRROR
+#define	MAX_GENIE_MIRROR	0
+#endif
+
+#ifdef GENIE_WRITE_ONLY
+#undef	MAX_GENIE_FILTERS
+#define	MAX_GENIE_FILTERS	0
+#undef	MAX_GENIE_CACHE
+#define	MAX_GENIE_CACHE		0
+#if defined(GENIE_EVENT_TIMESTAMPS) || defined(GENIE_COMMAND_QUEUE)
+#error "GENIE_WRITE_ONLY can't be used with GENIE_EVENT_TIMESTAMPS or GENIE_COMMAND_QUEUE"
+#endif
+#endif
+
+#ifdef GENIE_MULTIDROP
+#ifndef MAX_GENIE_MIRROR
+#define	MAX_GENIE_MIRROR	0
+#elif MAX_GENIE_MIRROR > 0
+#error "GENIE_MULTIDROP can't be used with the state mirror, MAX_GENIE_MIRROR must be 0"
+#endif
+#endif
+
+#ifdef GENIE_NO_STRINGS
+#undef	MAX_GENIE_MIRROR_STRS
+#define	MAX_GENIE_MIRROR_STRS	0
+#endif
+
 #define	GENIE_VERSION	"GenieArduino 24-Jul-2013"
 
 // Genie commands & replys:
@@ -43,6 +150,11 @@
 
 #define TIMEOUT_PERIOD	500
 #define RESYNC_PERIOD	100
+#define HEARTBEAT_PERIOD	1000	// idle time before the link is checked, 0 to disable
+#define PROBE_PERIOD		1000	// time between attempts to find a display that is down
+#ifndef PROBE_TIMEOUT
+#define PROBE_TIMEOUT		25		// time a heartbeat or probe waits for its reply, raise it for slow links
+#endif
 
 #define	GENIE_READ_OBJ			0
 #define	GENIE_WRITE_OBJ			1
@@ -82,6 +194,18 @@
 #define	GENIE_OBJ_SOUND			22
 #define	GENIE_OBJ_TIMER			23
 
+/////////////////////////////////////////////////////////////////////
+// A typed reference to one object in a project, as written by 
+// tools/genieProjectGen.py, eg
+//
+//	genieWriteObject(Form0::Coolgauge0, 50);
+//
+struct genieObjectHandle {
+	uint8_t		object;
+	uint8_t		index;
+	uint8_t		form;
+};
+
 // Structure to store replys returned from a display
 
 #define		GENIE_FRAME_SIZE	6
@@ -111,16 +235,278 @@ union genieFrame {
 	genieFrameReportObj	reportObject;
 };
 
+#ifndef MAX_GENIE_EVENTS
 #define	MAX_GENIE_EVENTS	16	// MUST be a power of 2
-#define	MAX_GENIE_FATALS	10
+#endif
+#if MAX_GENIE_EVENTS < 4 || MAX_GENIE_EVENTS > 256 || (MAX_GENIE_EVENTS & (MAX_GENIE_EVENTS - 1)) != 0
+#error "MAX_GENIE_EVENTS must be a power of 2 from 4 to 256"
+#endif
+#define	MAX_GENIE_FATALS	3	// consecutive failures before the display is declared down
+
+#ifdef GENIE_QUEUE_STATS
+/////////////////////////////////////////////////////////////////////
+// Queue statistics
+//
+// How full a queue has been, the most entries it has held, the 
+// number lost because it was full and the mS it has spent holding 
+// more than GENIE_QUEUE_THRESHOLD entries, or the threshold set with
+// genieSetQueueThreshold(). Used to choose MAX_GENIE_EVENTS and 
+// MAX_GENIE_COMMANDS, see tools/genieQueueSizer.sh.
+//
+#ifndef GENIE_QUEUE_THRESHOLD
+#define	GENIE_QUEUE_THRESHOLD	(MAX_GENIE_EVENTS / 2)
+#endif
+
+struct genieQueueStatsStruct {
+	uint32_t	above_ms;		// mS spent holding more than threshold entries
+	uint32_t	above_since;	// millis() when it last went above the threshold
+	uint32_t	queued;			// entries added
+	uint32_t	overflows;		// entries lost because the queue was full
+	uint8_t		level;			// entries held now
+	uint8_t		high_water;		// most entries held at once
+	uint8_t		threshold;
+};
+#endif
 
 struct genieEventQueueStruct {
 	genieFrame	frames[MAX_GENIE_EVENTS];
+#ifdef GENIE_QUEUE_STATS
+	genieQueueStatsStruct	stats;
+#endif
+#ifdef GENIE_EVENT_TIMESTAMPS
+	uint32_t	stamps[MAX_GENIE_EVENTS];	// micros() at each frame's first byte
+	uint8_t		n_undispatched;				// frames not yet seen by the handler
+#endif
 	uint8_t		rd_index;
 	uint8_t		wr_index;
 	uint8_t		n_events;
 };
 
+#ifdef GENIE_EVENT_TIMESTAMPS
+/////////////////////////////////////////////////////////////////////
+// Latency statistics, in uS from the first byte of a frame being 
+// received to
+//	dispatch:	the user's handler being called with it queued
+//	residence:	it being released from the queue
+//
+struct genieLatencyStruct {
+	uint32_t	count;
+	uint32_t	total;
+	uint32_t	max;
+};
+#endif
+
+/////////////////////////////////////////////////////////////////////
+// Event filters
+//
+// Frames received from the display are checked against the filter 
+// table before they are queued, the first filter that matches the 
+// frame's cmd, object and index decides whether it is kept or 
+// dropped. Frames that match no filter get the default action.
+// There are MAX_GENIE_FILTERS filters, none unless it is defined.
+//
+// cmd_mask and object_mask have one bit per command/object number, eg
+//
+//	GENIE_CMD_BIT(GENIE_REPORT_EVENT)
+//	GENIE_OBJ_BIT(GENIE_OBJ_SLIDER) | GENIE_OBJ_BIT(GENIE_OBJ_KNOB)
+//
+#ifndef MAX_GENIE_FILTERS
+#define	MAX_GENIE_FILTERS	0
+#endif
+
+#define	GENIE_FILTER_ALLOW		0
+#define	GENIE_FILTER_DENY		1
+#define	GENIE_FILTER_DEFAULT	0xFF	// filter number for default drops
+
+#define	GENIE_CMD_BIT(c)		(1 << (c))
+#define	GENIE_OBJ_BIT(o)		(1UL << (o))
+#define	GENIE_CMD_ALL			0xFF
+#define	GENIE_OBJ_ALL			0xFFFFFFFFUL
+
+struct genieEventFilterStruct {
+	uint32_t	object_mask;
+	uint16_t	drops;			// frames dropped by this filter
+	uint8_t		cmd_mask;
+	uint8_t		index_min;
+	uint8_t		index_max;
+	uint8_t		action;
+};
+
+/////////////////////////////////////////////////////////////////////
+// Object value cache
+//
+// The most recent value reported by the display for up to 
+// MAX_GENIE_CACHE (object, index) pairs, taken from REPORT_EVENT
+// and REPORT_OBJ frames as they are received. When the cache is 
+// full the entry that has gone longest without an update is reused.
+// Left out unless MAX_GENIE_CACHE is defined or GENIE_COMMAND_QUEUE,
+// which needs it, is used.
+//
+#ifndef MAX_GENIE_CACHE
+#ifdef GENIE_COMMAND_QUEUE
+#define	MAX_GENIE_CACHE		8
+#else
+#define	MAX_GENIE_CACHE		0
+#endif
+#endif
+#define	GENIE_CACHE_EMPTY	0xFF
+
+struct genieCacheEntryStruct {
+	uint32_t	stamp;			// millis() when the value was received
+	uint16_t	value;
+	uint8_t		object;			// GENIE_CACHE_EMPTY if unused
+	uint8_t		index;
+#ifdef GENIE_MULTIDROP
+	uint8_t		display;		// the display it came from
+#endif
+};
+
+/////////////////////////////////////////////////////////////////////
+// Display state mirror
+//
+// The last value written to up to MAX_GENIE_MIRROR objects, and the
+// last string written to up to MAX_GENIE_MIRROR_STRS string objects,
+// along with the active form and contrast. When the display restarts, 
+// or comes back after being down, the mirror is replayed to it so it
+// shows the same thing it did before. A restart is seen as a heartbeat
+// or probe going unanswered and a later one being answered, the form
+// a display reports is taken as the one the user has chosen. Writes 
+// made while the display is down only update the mirror.
+//
+// Left out unless MAX_GENIE_MIRROR is defined. Strings longer than
+// MAX_GENIE_MIRROR_STR_LEN are not mirrored, set MAX_GENIE_MIRROR_STRS
+// to 0 to mirror no strings at all.
+//
+#ifndef MAX_GENIE_MIRROR
+#define	MAX_GENIE_MIRROR			0
+#endif
+#if MAX_GENIE_MIRROR == 0
+#undef	MAX_GENIE_MIRROR_STRS
+#define	MAX_GENIE_MIRROR_STRS		0
+#endif
+#ifndef MAX_GENIE_MIRROR_STRS
+#define	MAX_GENIE_MIRROR_STRS		2
+#endif
+#ifndef MAX_GENIE_MIRROR_STR_LEN
+#define	MAX_GENIE_MIRROR_STR_LEN	16
+#endif
+
+struct genieMirrorEntryStruct {
+	uint16_t	value;
+	uint8_t		form;			// the form that was active when written
+	uint8_t		object;
+	uint8_t		index;
+};
+
+struct genieMirrorStrStruct {
+	uint8_t		code;			// GENIE_WRITE_STR or GENIE_WRITE_STRU, 0 if unused
+	uint8_t		index;
+	char		text[MAX_GENIE_MIRROR_STR_LEN + 1];
+};
+
+#ifdef GENIE_MULTIDROP
+/////////////////////////////////////////////////////////////////////
+// Multidrop
+//
+// Up to MAX_GENIE_DISPLAYS displays share one serial bus, each with
+// its own address. Every transmission on the bus, commands from the
+// host and ACKs, NAKs, reports and events from the displays, starts
+// with the address of the display it is to or from. The rest is the
+// normal frame with its normal checksum.
+//
+// This address prefix is this library's own convention, it is not 
+// the Workshop4 Multidrop protocol and a display running a standard
+// ViSi-Genie program won't send or expect it. Each display needs a 
+// bridge, or a program, that adds and strips its address.
+//
+// genieSelectDisplay() chooses the display commands are sent to and
+// the cache is read for. Each display has its own event queue, 
+// genieDoEvents() calls the user's handler for each display with 
+// queued events in turn and genieGetEventDisplay() tells the handler
+// which one it is reading. Each display has its own failure count 
+// and down state, the link monitor probes the displays in turn and
+// one that is down only fails the commands sent to it.
+//
+#ifndef MAX_GENIE_DISPLAYS
+#define	MAX_GENIE_DISPLAYS	4
+#endif
+#define	GENIE_NO_DISPLAY	0xFF
+
+struct genieDisplayStatsStruct {
+	uint16_t	acks;
+	uint16_t	naks;
+	uint16_t	timeouts;		// commands the display didn't answer
+	uint16_t	events;			// frames queued from the display
+	uint16_t	drops;			// frames lost because its queue was full
+	uint16_t	fatals;			// commands and probes it has failed to answer in a row
+	bool		down;			// it has been declared down, commands to it fail at once
+};
+#endif
+
+#if defined(GENIE_COMMAND_QUEUE) && MAX_GENIE_CACHE == 0
+#error "GENIE_COMMAND_QUEUE needs the value cache, MAX_GENIE_CACHE > 0"
+#endif
+
+#ifdef GENIE_COMMAND_QUEUE
+/////////////////////////////////////////////////////////////////////
+// Command queue
+//
+// Any thread can submit commands with genieSubmitCommand(), a single 
+// link thread owns the serial port and runs them in 
+// genieServiceCommands(). Submission is lock-free, it needs the 
+// GCC __atomic builtins.
+//
+// The completion function is called from the link thread with the 
+// command's result (ERROR_NONE, ERROR_NAK, ERROR_TIMEOUT or 
+// ERROR_NODISPLAY) and, for a read, the object's value.
+//
+#ifndef MAX_GENIE_COMMANDS
+#define	MAX_GENIE_COMMANDS	16	// MUST be a power of 2
+#endif
+#if MAX_GENIE_COMMANDS < 2 || (MAX_GENIE_COMMANDS & (MAX_GENIE_COMMANDS - 1)) != 0
+#error "MAX_GENIE_COMMANDS must be a power of 2"
+#endif
+#ifndef MAX_GENIE_CMD_STR
+#define	MAX_GENIE_CMD_STR	32	// longest string that can be queued
+#endif
+
+typedef void		(*genieCompletionPtr)		(void * arg, int16_t result, uint16_t value);
+
+struct genieCommandStruct {
+	uint32_t			seq;	// slot sequence number, owned by the queue
+	genieCompletionPtr	done;
+	void *				arg;
+	uint16_t			data;
+	uint8_t				cmd;
+	uint8_t				object;
+	uint8_t				index;
+	char				string[MAX_GENIE_CMD_STR + 1];
+};
+
+struct genieCommandQueueStruct {
+	genieCommandStruct	slots[MAX_GENIE_COMMANDS];
+	uint32_t			wr_pos;	// shared by the producers
+	uint32_t			rd_pos;	// owned by the link thread
+};
+#endif
+
+// Largest number of characters genieDoEvents() reads from a Stream 
+// at once
+#ifndef GENIE_RX_CHUNK
+#define	GENIE_RX_CHUNK		16
+#endif
+
+// Size of the buffer, on the stack, string frames are built in when
+// the link is a Stream. A string of up to GENIE_TX_CHUNK - 4 
+// characters reaches the Stream in one write, longer ones in writes
+// of GENIE_TX_CHUNK. The serial ports are written a character at a
+// time and don't use it.
+#ifndef GENIE_TX_CHUNK
+#define	GENIE_TX_CHUNK		32
+#endif
+
+class Stream;
+
 typedef void		(*geniePutCharFuncPtr)		(uint8_t c, uint32_t baud);
 typedef uint16_t	(*genieGetCharFuncPtr)		(void);
 typedef void		(*genieUserEventHandlerPtr) (void);
@@ -131,16 +517,87 @@ typedef void		(*genieUserEventHandlerPtr) (void);
 //
 extern void		genieSetup				(uint32_t baud);
 extern uint16_t genieBegin				(uint8_t port, uint32_t baud);
-extern bool		genieReadObject			(uint16_t object, uint16_t index);
+extern uint16_t genieBegin				(Stream & stream);
 extern uint16_t	genieWriteObject		(uint16_t object, uint16_t index, uint16_t data);
+extern uint16_t	genieWriteObject		(genieObjectHandle h, uint16_t data);
 extern void		genieWriteContrast		(uint16_t value);
+#ifndef GENIE_NO_STRINGS
 extern uint16_t	genieWriteStr			(uint16_t index, char *string);
 extern uint16_t	genieWriteStrU			(uint16_t index, char *string);
+// genieWriteStrf() understands %d %i %u %x %X %c %s and %% with the
+// flags - 0 + and space, a width of up to 255 and h, hh or l. Any
+// other conversion, eg %f, %.2f or %*d, is rejected and -1 returned
+// with nothing sent.
+extern uint16_t	genieWriteStrf			(uint16_t index, const char * fmt, ...);
+#endif
+extern uint16_t	genieDoEvents			(void);
+extern uint16_t	genieRxByte				(uint8_t c);
+#ifndef GENIE_WRITE_ONLY
+extern bool		genieReadObject			(uint16_t object, uint16_t index);
+extern bool		genieReadObject			(genieObjectHandle h);
 extern bool		genieEventIs			(genieFrame * e, uint8_t cmd, uint8_t object, uint8_t index);
+extern bool		genieEventIs			(genieFrame * e, uint8_t cmd, genieObjectHandle h);
 extern uint16_t genieGetEventData		(genieFrame * e); 
-extern uint16_t	genieDoEvents			(void);
 extern void		genieAttachEventHandler (genieUserEventHandlerPtr userHandler);
 extern bool		genieDequeueEvent		(genieFrame * buff);
+extern const genieFrame * geniePeekEvents	(uint8_t * count);
+extern void		genieConsumeEvents		(uint8_t count);
+#endif
+#ifdef GENIE_EVENT_TIMESTAMPS
+extern bool		genieDequeueEventTimed	(genieFrame * buff, uint32_t * stamp);
+extern const uint32_t * geniePeekEventTimes	(void);
+extern void		genieGetLatencyStats	(genieLatencyStruct * dispatch, genieLatencyStruct * residence);
+extern void		genieResetLatencyStats	(void);
+#endif
+#if MAX_GENIE_FILTERS > 0
+extern int8_t	genieAddEventFilter		(uint8_t action, uint8_t cmd_mask, uint32_t object_mask,
+										 uint8_t index_min, uint8_t index_max);
+extern void		genieClearEventFilters	(void);
+extern void		genieSetFilterDefault	(uint8_t action);
+extern uint16_t	genieGetFilterDrops		(uint8_t filter);
+#endif
+#if MAX_GENIE_CACHE > 0
+extern bool		genieGetCachedValue		(uint16_t object, uint16_t index, uint16_t * value, uint32_t * age);
+extern bool		genieReadCachedObject	(uint16_t object, uint16_t index, uint32_t ttl, uint16_t * value);
+#endif
+#ifndef GENIE_NO_LINK_MONITOR
+extern void		genieSetLinkHealth		(uint8_t max_failures, uint16_t heartbeat, uint16_t probe);
+#endif
+extern bool		genieLinkIsUp			(void);
+#if MAX_GENIE_MIRROR > 0
+extern uint32_t	genieRestoreState		(void);
+#endif
+
+#ifdef GENIE_MULTIDROP
+extern bool		genieAddDisplay			(uint8_t address);
+extern bool		genieSelectDisplay		(uint8_t address);
+extern bool		genieGetDisplayStats	(uint8_t address, genieDisplayStatsStruct * stats);
+#ifndef GENIE_WRITE_ONLY
+extern uint8_t	genieGetEventDisplay	(void);
+#endif
+#endif
+
+#ifdef GENIE_QUEUE_STATS
+#ifndef GENIE_WRITE_ONLY
+extern void		genieGetQueueStats		(genieQueueStatsStruct * stats);
+#endif
+#ifdef GENIE_COMMAND_QUEUE
+extern void		genieGetCommandQueueStats	(genieQueueStatsStruct * stats);
+#endif
+extern void		genieResetQueueStats	(void);
+extern void		genieSetQueueThreshold	(uint8_t threshold);
+#endif
+
+#ifdef GENIE_RX_INTERRUPT
+extern void		genieRxInterrupt		(void);
+extern uint32_t	genieGetRxMaxTime		(void);
+#endif
+
+#ifdef GENIE_COMMAND_QUEUE
+extern bool		genieSubmitCommand		(uint8_t cmd, uint16_t object, uint16_t index, uint16_t data,
+										 const char * string, genieCompletionPtr done, void * arg);
+extern uint16_t	genieServiceCommands	(void);
+#endif
 
 extern void		pulse (int pin);
 
@@ -206,6 +663,21 @@ extern void		pulse (int pin);
 #define SERIAL_3
 #endif
 
+#ifdef GENIE_SINGLE_PORT
+#if GENIE_SINGLE_PORT != 0
+#undef SERIAL
+#endif
+#if GENIE_SINGLE_PORT != 1
+#undef SERIAL_1
+#endif
+#if GENIE_SINGLE_PORT != 2
+#undef SERIAL_2
+#endif
+#if GENIE_SINGLE_PORT != 3
+#undef SERIAL_3
+#endif
+#endif
+
 typedef enum {
   GENIE_NULL,
   GENIE_SERIAL,
@@ -0,0 +1,179 @@
+/////////////////////// genieBusSim ///////////////////////
+//
+//      Run three displays on a simulated multidrop bus: all of them
+//      answering, then with display 2 gone while the sketch keeps
+//      writing to all three, then with display 2 back. Displays 1
+//      and 3 must carry on as if nothing had happened while display
+//      2 is declared down and then probed back up.
+//
+//      Until display 2 is declared down the sketch's own writes to it
+//      wait out TIMEOUT_PERIOD, the bus can't be used until they have.
+//      After that a write to display 1 or 3 may only wait behind a 
+//      probe of display 2, at most PROBE_TIMEOUT, or the check fails.
+//      A report from display 1 arriving during a probe of display 2
+//      mustn't be taken as display 2's reply.
+//
+//      Usage:	genieBusSim
+//
+//      Build with -DGENIE_MULTIDROP, see genieHostTests.sh.
+//
+//      Copyright (c) 2012-2013 4D Systems PTY Ltd, Sydney, Australia
+//      This file is part of genieArduino, see COPYING for the licence.
+//
+
+#include "genieHostLink.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef GENIE_MULTIDROP
+#error "build with -DGENIE_MULTIDROP"
+#endif
+
+#define	DISPLAYS	3
+#define	BAUD		115200
+#define	MAX_WRITE_US	((PROBE_TIMEOUT + 5) * 1000UL)	// slowest write to a live display allowed
+
+static HostLink		_link;
+static HostDisplay *_displays[DISPLAYS];	// addresses 1 to 3
+static bool			_ok = TRUE;
+
+////////////////////// check /////////////////////////////////
+//
+static void check (bool cond, const char * what) {
+	if (!cond) {
+		printf("FAIL %s\n", what);
+		_ok = FALSE;
+	}
+}
+
+////////////////////// handler ///////////////////////////////
+//
+static void handler (void) {
+	genieFrame f;
+
+	while (genieDequeueEvent(&f))
+		;
+}
+
+////////////////////// run ///////////////////////////////////
+//
+// Call genieDoEvents() for ms of simulated time
+//
+static void run (uint32_t ms) {
+	uint64_t end = hostNow + ms * 1000ULL;
+
+	while (hostNow < end) {
+		genieDoEvents();
+		hostNow += 10;
+	}
+}
+
+////////////////////// stats /////////////////////////////////
+//
+static genieDisplayStatsStruct stats (uint8_t address) {
+	genieDisplayStatsStruct s;
+
+	genieGetDisplayStats(address, &s);
+	return s;
+}
+
+////////////////////// write /////////////////////////////////
+//
+// Write to a display and wait for the bus to be idle again
+//
+// Returns:	the result of genieWriteObject()
+//
+static uint16_t write (uint8_t address, uint16_t value, uint32_t * us) {
+	uint64_t start = hostNow;
+	uint16_t result;
+
+	genieSelectDisplay(address);
+	result = genieWriteObject(GENIE_OBJ_LED_DIGITS, 0, value);
+	run(5);
+	if (us != NULL)
+		*us = (uint32_t)(hostNow - start);
+	return result;
+}
+
+int main (void) {
+	uint32_t us, slowest = 0, slowest_down = 0;
+	uint16_t pass, result, fatals;
+	uint8_t a;
+
+	_link.multidrop = TRUE;
+	_link.byte_us = 10000000UL / BAUD;
+	_link.reply_us = 500;
+	_link.poll_us = 100;
+	genieBegin(_link);
+	genieAttachEventHandler(handler);
+	for (a = 1; a <= DISPLAYS; a++) {
+		_displays[a - 1] = _link.addDisplay(a);
+		genieAddDisplay(a);
+	}
+
+	// all up
+	for (pass = 0; pass < 10; pass++) {
+		for (a = 1; a <= DISPLAYS; a++)
+			check(write(a, pass * 10 + a, NULL) == ERROR_NONE, "write with all displays up");
+	}
+	for (a = 1; a <= DISPLAYS; a++) {
+		check(_displays[a - 1]->values[GENIE_OBJ_LED_DIGITS << 8] == 90 + a, "value with all displays up");
+		check(stats(a).acks == 10 && !stats(a).down, "ACKs with all displays up");
+	}
+	printf("all up:       %u ACKs each\n", stats(1).acks);
+
+	// display 2 goes, keep writing to all three for 10 seconds
+	_displays[1]->alive = FALSE;
+	for (pass = 0; hostNow < 10000000ULL + 1000000ULL * 10; pass++) {
+		for (a = 1; a <= DISPLAYS; a++) {
+			bool down = stats(2).down;
+
+			result = write(a, pass, &us);
+			if (a == 2)
+				continue;
+			check(result == ERROR_NONE, "write to a live display with display 2 gone");
+			check(_displays[a - 1]->values[GENIE_OBJ_LED_DIGITS << 8] == pass, "value with display 2 gone");
+			if (!down && us > slowest)
+				slowest = us;
+			if (down && us > slowest_down)
+				slowest_down = us;
+		}
+	}
+	check(!stats(1).down && !stats(3).down, "displays 1 and 3 up with display 2 gone");
+	check(stats(2).down, "display 2 down");
+	check(slowest_down <= MAX_WRITE_US, "writes to displays 1 and 3 held up by display 2's probes");
+	genieSelectDisplay(2);
+	check(!genieLinkIsUp(), "genieLinkIsUp() for display 2");
+	us = hostNow;
+	check((int16_t)genieWriteObject(GENIE_OBJ_LED_DIGITS, 0, 1) == ERROR_NODISPLAY && hostNow == us,
+		  "write to display 2 fails at once");
+	genieSelectDisplay(1);
+	check(genieLinkIsUp(), "genieLinkIsUp() for display 1");
+
+	// a report from display 1 arrives while display 2 is being 
+	// probed, it mustn't be taken as display 2's reply
+	us = _displays[1]->addressed;
+	fatals = stats(2).fatals;
+	while (_displays[1]->addressed == us)
+		run(1);
+	_link.sendReport(_displays[0], GENIE_OBJ_FORM, 0, 0);
+	run(PROBE_TIMEOUT * 2);
+	check(stats(2).down && stats(2).fatals == fatals + 1, "display 1's report taken as display 2's probe reply");
+	printf("display 2 gone: %u passes, display 1 %u ACKs, display 2 %u timeouts\n",
+		   pass, stats(1).acks, stats(2).timeouts);
+	printf("slowest write to 1 or 3 %.1f mS before display 2 was declared down, %.1f mS after, %.1f mS allowed\n",
+		   slowest / 1000.0, slowest_down / 1000.0, MAX_WRITE_US / 1000.0);
+
+	// display 2 comes back and is probed up
+	_displays[1]->alive = TRUE;
+	run(PROBE_PERIOD * DISPLAYS + TIMEOUT_PERIOD);
+	check(!stats(2).down, "display 2 probed up");
+	check(write(2, 1234, NULL) == ERROR_NONE && _displays[1]->values[GENIE_OBJ_LED_DIGITS << 8] == 1234,
+		  "write to display 2 once it is back");
+	printf("display 2 back: %s\n", stats(2).down ? "down" : "up");
+
+	if (_ok)
+		printf("ok\n");
+	return _ok ? 0 : 1;
+}
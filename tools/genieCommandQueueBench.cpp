@@ -0,0 +1,182 @@
+/////////////////////// genieCommandQueueBench ///////////////////////
+//
+//      Measure the command queue's throughput on a PC against a
+//      mutex-wrapped queue of the same depth. For each number of
+//      producer threads every producer submits the same number of
+//      writes while the link thread runs them, once through
+//      genieSubmitCommand() and genieServiceCommands() and once
+//      through the mutex queue and genieWriteObject(). Both wait for
+//      each write's ACK before calling its completion. The display
+//      answers at once, so the queue and the library are all that
+//      is timed.
+//
+//      Usage:	genieCommandQueueBench [commands each [producers ...]]
+//
+//      Output:	<producers> <lock-free commands/s> <mutex commands/s>
+//
+//      Build with -DGENIE_COMMAND_QUEUE, see genieHostTests.sh.
+//
+//      Copyright (c) 2012-2013 4D Systems PTY Ltd, Sydney, Australia
+//      This file is part of genieArduino, see COPYING for the licence.
+//
+
+#include "genieHostLink.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifndef GENIE_COMMAND_QUEUE
+#error "build with -DGENIE_COMMAND_QUEUE"
+#endif
+
+#define	RUNS		3		// the best of
+
+// the library's wait for an ACK, as genieServiceCommands() uses
+extern void _genieWaitForIdle (void);
+
+static HostLink				_link;
+static std::atomic<bool>	_go;
+static uint32_t				_completions;	// link thread only
+
+//////////////////////////////////////////////////////////////
+// The baseline, a ring of commands guarded by a mutex
+//
+static std::mutex			_lock;
+static genieCommandStruct	_ring[MAX_GENIE_COMMANDS];
+static uint32_t				_ringWr, _ringRd;
+
+////////////////////// seconds ///////////////////////////////
+//
+static double seconds (void) {
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+////////////////////// done //////////////////////////////////
+//
+static void done (void * arg, int16_t result, uint16_t value) {
+	_completions++;
+}
+
+////////////////////// mutexSubmit ///////////////////////////
+//
+static bool mutexSubmit (uint8_t object, uint8_t index, uint16_t data) {
+	std::lock_guard<std::mutex> hold(_lock);
+	genieCommandStruct * slot;
+
+	if (_ringWr - _ringRd == MAX_GENIE_COMMANDS)
+		return false;
+	slot = &_ring[_ringWr++ % MAX_GENIE_COMMANDS];
+	slot->cmd		= GENIE_WRITE_OBJ;
+	slot->object	= object;
+	slot->index		= index;
+	slot->data		= data;
+	slot->done		= done;
+	slot->arg		= NULL;
+	return true;
+}
+
+////////////////////// mutexService //////////////////////////
+//
+// As genieServiceCommands() but for the mutex queue, each write's
+// ACK is waited for before its completion is called.
+//
+static void mutexService (void) {
+	genieCommandStruct c;
+
+	for (;;) {
+		{
+			std::lock_guard<std::mutex> hold(_lock);
+			if (_ringRd == _ringWr)
+				break;
+			c = _ring[_ringRd++ % MAX_GENIE_COMMANDS];
+		}
+		genieWriteObject(c.object, c.index, c.data);
+		_genieWaitForIdle();
+		(c.done)(c.arg, ERROR_NONE, 0);
+	}
+	genieDoEvents();
+}
+
+////////////////////// producer //////////////////////////////
+//
+static void producer (bool mutex, uint8_t p, uint32_t commands) {
+	uint32_t i;
+
+	while (!_go.load())
+		std::this_thread::yield();
+
+	for (i = 0; i < commands; i++) {
+		while (!(mutex ? mutexSubmit(p, i & 0xFF, i) :
+				genieSubmitCommand(GENIE_WRITE_OBJ, p, i & 0xFF, i, NULL, done, NULL)))
+			std::this_thread::yield();
+	}
+}
+
+////////////////////// run ///////////////////////////////////
+//
+// Returns:	commands per second
+//
+static double run (bool mutex, uint32_t producers, uint32_t commands) {
+	std::vector<std::thread> threads;
+	uint32_t total = producers * commands;
+	double start;
+	uint32_t p;
+
+	_completions = 0;
+	_link.displays[0].commands.clear();
+	_go = false;
+	for (p = 0; p < producers; p++)
+		threads.push_back(std::thread(producer, mutex, p, commands));
+
+	start = seconds();
+	_go = true;
+	while (_completions < total) {
+		if (mutex)
+			mutexService();
+		else
+			genieServiceCommands();
+		if (_completions < total)
+			std::this_thread::yield();
+	}
+	start = seconds() - start;
+
+	for (p = 0; p < producers; p++)
+		threads[p].join();
+
+	return total / start;
+}
+
+int main (int argc, char ** argv) {
+	uint32_t commands = (argc > 1) ? atoi(argv[1]) : 20000;
+	uint32_t counts[] = { 1, 2, 4, 8 };
+	uint32_t n_counts = sizeof(counts) / sizeof(counts[0]);
+	int i, r;
+
+	_link.addDisplay(0);
+	genieBegin(_link);
+
+	printf("%9s %16s %16s\n", "producers", "lock-free cmd/s", "mutex cmd/s");
+	for (i = 0; i < (argc > 2 ? argc - 2 : (int)n_counts); i++) {
+		uint32_t producers = (argc > 2) ? atoi(argv[i + 2]) : counts[i];
+		double lock_free = 0, mutex = 0;
+
+		for (r = 0; r < RUNS; r++) {
+			double t = run(FALSE, producers, commands);
+			if (t > lock_free)
+				lock_free = t;
+			t = run(TRUE, producers, commands);
+			if (t > mutex)
+				mutex = t;
+		}
+		printf("%9u %16.0f %16.0f\n", producers, lock_free, mutex);
+	}
+	return 0;
+}
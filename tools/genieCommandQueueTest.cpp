@@ -0,0 +1,183 @@
+/////////////////////// genieCommandQueueTest ///////////////////////
+//
+//      Check the command queue on a PC. Several producer threads
+//      each submit a run of numbered writes with genieSubmitCommand()
+//      while the link thread runs them with genieServiceCommands().
+//      Every write must reach the display once, with a good
+//      checksum, in the order its producer submitted it, and every
+//      completion must be called once with ERROR_NONE. Then a read 
+//      is queued while events wait for the handler, it must return 
+//      the display's value and leave the events queued.
+//
+//      Usage:	genieCommandQueueTest [producers [commands each]]
+//
+//      Build with -DGENIE_COMMAND_QUEUE, see genieHostTests.sh, it is
+//      meant to be run under -fsanitize=thread as well.
+//
+//      Copyright (c) 2012-2013 4D Systems PTY Ltd, Sydney, Australia
+//      This file is part of genieArduino, see COPYING for the licence.
+//
+
+#include "genieHostLink.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+#ifndef GENIE_COMMAND_QUEUE
+#error "build with -DGENIE_COMMAND_QUEUE"
+#endif
+
+#define	MAX_PRODUCERS	64
+#define	READ_EVENTS		3		// events waiting while the read is serviced
+
+// the display answers at once, only the link thread touches it
+static HostLink		_link;
+static uint32_t		_completions[MAX_PRODUCERS];	// link thread only
+static uint32_t		_failures = 0;
+static bool			_take = FALSE;		// the handler takes events
+static uint32_t		_events = 0;		// events the handler took
+static int16_t		_readResult = 1;	// 1 until the read completes
+static uint16_t		_readValue;
+
+////////////////////// handler ///////////////////////////////
+//
+static void handler (void) {
+	genieFrame f;
+
+	while (_take && genieDequeueEvent(&f)) {
+		if (f.reportObject.cmd == GENIE_REPORT_EVENT)
+			_events++;
+	}
+}
+
+////////////////////// readDone //////////////////////////////
+//
+static void readDone (void * arg, int16_t result, uint16_t value) {
+	_readValue = value;
+	_readResult = result;
+}
+
+////////////////////// readProducer //////////////////////////
+//
+static void readProducer (void) {
+	while (!genieSubmitCommand(GENIE_READ_OBJ, GENIE_OBJ_SLIDER, 7, 0, NULL, readDone, NULL))
+		std::this_thread::yield();
+}
+
+////////////////////// readEvents ////////////////////////////
+//
+// Returns:	TRUE if a read serviced while events are queued returns
+//			the display's value and the events are still there
+//
+static bool readEvents (void) {
+	uint8_t queued = 0;
+	uint8_t i;
+
+	_link.displays[0].values[(GENIE_OBJ_SLIDER << 8) | 7] = 4321;
+	for (i = 0; i < READ_EVENTS; i++)
+		_link.sendEvent(&_link.displays[0], GENIE_OBJ_WINBUTTON, i, 1);
+	while (queued < READ_EVENTS) {
+		genieDoEvents();
+		geniePeekEvents(&queued);
+	}
+
+	std::thread(readProducer).join();
+	while (_readResult == 1)
+		genieServiceCommands();
+
+	_take = TRUE;
+	genieDoEvents();
+
+	if (_readResult != ERROR_NONE || _readValue != 4321 || _events != READ_EVENTS) {
+		printf("FAIL read with events queued: result %d value %u, %u of %u events left\n",
+			   _readResult, _readValue, _events, READ_EVENTS);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+////////////////////// done //////////////////////////////////
+//
+static void done (void * arg, int16_t result, uint16_t value) {
+	if (result != ERROR_NONE)
+		_failures++;
+	_completions[(uintptr_t)arg]++;
+}
+
+////////////////////// producer //////////////////////////////
+//
+// Submit commands writes of 0 to commands - 1 to object p
+//
+static void producer (uint8_t p, uint32_t commands) {
+	uint32_t i;
+
+	for (i = 0; i < commands; i++) {
+		while (!genieSubmitCommand(GENIE_WRITE_OBJ, p, i & 0xFF, i, NULL, done, (void *)(uintptr_t)p))
+			std::this_thread::yield();
+	}
+}
+
+int main (int argc, char ** argv) {
+	std::vector<std::thread> threads;
+	uint32_t next[MAX_PRODUCERS] = { 0 };
+	uint32_t producers = (argc > 1) ? atoi(argv[1]) : 8;
+	uint32_t commands = (argc > 2) ? atoi(argv[2]) : 2000;
+	uint32_t total = producers * commands;
+	uint32_t completed = 0;
+	uint32_t errors = 0;
+	uint32_t i, p;
+
+	if (producers == 0 || producers > MAX_PRODUCERS) {
+		fprintf(stderr, "usage: %s [producers (1-%d) [commands each]]\n", argv[0], MAX_PRODUCERS);
+		return 1;
+	}
+
+	_link.addDisplay(0);
+	genieBegin(_link);
+	genieAttachEventHandler(handler);
+
+	for (p = 0; p < producers; p++)
+		threads.push_back(std::thread(producer, p, commands));
+
+	while (completed < total) {
+		if (genieServiceCommands() == 0)
+			std::this_thread::yield();
+		for (completed = 0, p = 0; p < producers; p++)
+			completed += _completions[p];
+	}
+
+	for (p = 0; p < producers; p++)
+		threads[p].join();
+
+	// each producer's writes arrive once and in order, the display
+	// NAKs any that are corrupt
+	std::vector< std::vector<uint8_t> > & writes = _link.displays[0].commands;
+
+	if (writes.size() != total) {
+		printf("FAIL %u writes sent, %u received\n", total, (unsigned)writes.size());
+		return 1;
+	}
+	for (i = 0; i < total; i++) {
+		uint8_t * f = &writes[i][0];
+
+		p = f[1];
+		if (f[0] != GENIE_WRITE_OBJ || p >= producers || 
+			(uint16_t)((f[3] << 8) | f[4]) != (uint16_t)next[p]) {
+			errors++;
+			continue;
+		}
+		next[p]++;
+	}
+
+	if (errors != 0 || _failures != 0 || _link.displays[0].naks != 0) {
+		printf("FAIL %u writes out of order, %u corrupt, %u completions failed\n", 
+			   errors, _link.displays[0].naks, _failures);
+		return 1;
+	}
+	if (!readEvents())
+		return 1;
+	printf("ok %u producers x %u commands, read with %u events queued\n", producers, commands, READ_EVENTS);
+	return 0;
+}
@@ -0,0 +1,183 @@
+/////////////////////// genieFormatTest ///////////////////////
+//
+//      Check genieWriteStrf() against the C library's snprintf() for
+//      the conversions it understands, that the ones it doesn't are
+//      rejected without anything being sent, and that formatted
+//      strings are mirrored, including while the display is down.
+//
+//      Usage:	genieFormatTest
+//
+//      Build with -DMAX_GENIE_MIRROR=4, see genieHostTests.sh.
+//
+//      Copyright (c) 2012-2013 4D Systems PTY Ltd, Sydney, Australia
+//      This file is part of genieArduino, see COPYING for the licence.
+//
+
+#include "genieHostLink.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+
+#if MAX_GENIE_MIRROR == 0 || MAX_GENIE_MIRROR_STRS == 0
+#error "build with -DMAX_GENIE_MIRROR=4"
+#endif
+
+#define	STR		3		// the string object written to
+
+static HostLink		_link;
+static HostDisplay *_display;
+static bool			_ok = TRUE;
+
+////////////////////// check /////////////////////////////////
+//
+static void check (bool cond, const char * what) {
+	if (!cond) {
+		printf("FAIL %s\n", what);
+		_ok = FALSE;
+	}
+}
+
+////////////////////// handler ///////////////////////////////
+//
+static void handler (void) {
+	genieFrame f;
+
+	while (genieDequeueEvent(&f))
+		;
+}
+
+////////////////////// run ///////////////////////////////////
+//
+// Call genieDoEvents() for ms of simulated time
+//
+static void run (uint32_t ms) {
+	uint64_t end = hostNow + ms * 1000ULL;
+
+	while (hostNow < end) {
+		genieDoEvents();
+		hostNow += 10;
+	}
+}
+
+////////////////////// same //////////////////////////////////
+//
+// The string genieWriteStrf() sent, when it returned result, must
+// be what snprintf() made of the same format
+//
+static void same (uint16_t result, const char * expected, const char * what) {
+	run(5);
+	if (result != 0 || _display->strings[STR] != expected) {
+		printf("FAIL genieWriteStrf(%s) returned %d sent \"%s\" expected \"%s\"\n", what,
+			   (int16_t)result, _display->strings[STR].c_str(), expected);
+		_ok = FALSE;
+	}
+	_display->strings.erase(STR);
+}
+
+////////////////////// rejected //////////////////////////////
+//
+// genieWriteStrf() must have returned -1 and sent nothing
+//
+static void rejected (uint16_t result, size_t commands, const char * what) {
+	run(5);
+	if ((int16_t)result != -1 || _display->commands.size() != commands) {
+		printf("FAIL genieWriteStrf(%s) returned %d and sent %u commands, it should be rejected\n",
+			   what, (int16_t)result, (unsigned)(_display->commands.size() - commands));
+		_ok = FALSE;
+	}
+}
+
+#define	SAME(...)		do {												\
+							char expected[300];								\
+							snprintf(expected, sizeof(expected), __VA_ARGS__);	\
+							same(genieWriteStrf(STR, __VA_ARGS__), expected, #__VA_ARGS__); \
+						} while (0)
+
+#define	REJECTED(...)	do {												\
+							size_t commands = _display->commands.size();	\
+							rejected(genieWriteStrf(STR, __VA_ARGS__), commands, #__VA_ARGS__); \
+						} while (0)
+
+int main (void) {
+	char wide[300];
+
+	_link.byte_us = 10000000UL / 115200;
+	_link.reply_us = 500;
+	_link.poll_us = 10;
+	_display = _link.addDisplay(0);
+	genieBegin(_link);
+	genieAttachEventHandler(handler);
+
+	// understood, as the C library
+	SAME("plain");
+	SAME("%d %i V", -42, 17);
+	SAME("%5d|%-5d|%05d|%-05d", 42, -7, -3, 9);
+	SAME("%+d %+d % d % d %+ d % +d", 5, -5, 5, -5, 5, 5);
+	SAME("%+05d|% 5d|%-+6d|", 12, 34, 56);
+	SAME("%u %lu %x %X %lx %08X", 65535u, 4000000000ul, 255u, 0xBEEFu, 0xdeadbeeful, 0xABCu);
+	SAME("%ld %ld %lu", LONG_MIN, LONG_MAX, ULONG_MAX);
+	SAME("%hd %hu %hhd %hhu %hx", 70000, 70000, 300, 300, 0x12345);
+	SAME("%c%c%% %3c|%-3c|", 'O', 'K', 'x', 'y');
+	SAME("[%8s][%-8s][%s][%1s]", "ab", "cd", "", "long");
+	SAME("%03u%%", 7u);
+	SAME("%255d", 1);
+	same(genieWriteStrf(STR, "[%s]", (const char *)NULL), "[]", "\"[%s]\", NULL");
+
+	// not understood, nothing is sent and no argument is misread
+	REJECTED("%f", 1.5);
+	REJECTED("%.2f", 1.5);
+	REJECTED("%5.1f", 1.5);
+	REJECTED("%e %g", 1.5, 2.5);
+	REJECTED("%.3d", 7);
+	REJECTED("%.5s", "abcdefgh");
+	REJECTED("%*d", 5, 7);
+	REJECTED("%lld", 1LL);
+	REJECTED("%hld", 1L);
+	REJECTED("%p", (void *)wide);
+	REJECTED("%o", 8);
+	REJECTED("%#x", 255);
+	REJECTED("%256d", 1);
+	REJECTED("%99999999999d", 1);
+	REJECTED("%d %q", 1, 2);
+	REJECTED("50%");
+
+	// longer than a frame holds
+	memset(wide, 'x', sizeof(wide) - 1);
+	wide[sizeof(wide) - 1] = 0;
+	REJECTED("%s", wide);
+	REJECTED("%200d%200d", 1, 2);
+
+	// short strings are mirrored as they are sent, a long one
+	// forgets the last, and a rejected one leaves the mirror alone
+	genieWriteStrf(1, "T=%d", 21);
+	run(5);
+	REJECTED("%f", 1.5);
+	genieWriteStrf(2, "ok");
+	run(5);
+	genieWriteStrf(2, "%40s", "");
+	run(5);
+	_display->strings.clear();
+	genieRestoreState();
+	run(5);
+	check(_display->strings.count(1) == 1 && _display->strings[1] == "T=21", "short string mirrored");
+	check(_display->strings.count(2) == 0, "long string mirrored");
+
+	// written while the display is down it is only mirrored, and
+	// shown once the display is back
+	_display->alive = FALSE;
+	while (genieLinkIsUp()) {
+		genieWriteObject(GENIE_OBJ_LED, 0, 1);
+		run(5);
+	}
+	check((int16_t)genieWriteStrf(1, "D=%03d", 7) == ERROR_NODISPLAY, "write while the display is down");
+	_display->alive = TRUE;
+	_display->strings.clear();
+	run(PROBE_PERIOD + TIMEOUT_PERIOD * 2);
+	check(genieLinkIsUp(), "display probed up");
+	check(_display->strings.count(1) == 1 && _display->strings[1] == "D=007", "string written while down restored");
+
+	if (_ok)
+		printf("ok\n");
+	return _ok ? 0 : 1;
+}
@@ -0,0 +1,65 @@
+#!/bin/sh
+#
+# genieHostTests.sh
+#
+#	Build the host tools against genieArduino on this PC and run
+#	them. The tests exit with a non-zero status if they fail, the
+#	benchmarks and simulations print their figures.
+#
+#	Usage:	genieHostTests.sh [tool ...]
+#
+#	With no tools named all of them are run. SANITIZE adds a
+#	sanitizer to the build, eg SANITIZE=thread for the command
+#	queue test, CXX chooses the compiler.
+#
+#	Copyright (c) 2012-2013 4D Systems PTY Ltd, Sydney, Australia
+#	This file is part of genieArduino, see COPYING for the licence.
+#
+
+CXX=${CXX:-c++}
+
+TOOLS=$(cd "$(dirname "$0")" && pwd)
+LIB="$TOOLS/../genieArduino"
+OUT=$(mktemp -d)
+trap 'rm -rf "$OUT"' EXIT
+
+# name, compiler flags and arguments of each tool, a name with a
+# -suffix is another build of the same source
+RXSIM="-DGENIE_QUEUE_STATS -DGENIE_NO_LINK_MONITOR -DMAX_GENIE_EVENTS=32"
+ALL="
+genieCommandQueueTest:-DGENIE_COMMAND_QUEUE -pthread:8 2000
+genieCommandQueueBench:-DGENIE_COMMAND_QUEUE -pthread:
+genieRestoreBench:-DMAX_GENIE_MIRROR=64:
+genieBusSim:-DGENIE_MULTIDROP:
+genieFormatTest:-DMAX_GENIE_MIRROR=4:
+genieRxInterruptSim:-DGENIE_RX_INTERRUPT $RXSIM:
+genieRxInterruptSim-polled:$RXSIM:
+"
+
+SAN=""
+[ -n "$SANITIZE" ] && SAN="-fsanitize=$SANITIZE"
+
+FAILED=""
+echo "$ALL" | {
+	while IFS=: read -r name flags args; do
+		[ -z "$name" ] && continue
+		if [ $# -gt 0 ]; then
+			case " $* " in
+				*" $name "*) ;;
+				*) continue ;;
+			esac
+		fi
+		echo "== $name"
+		if ! $CXX -O2 -g $SAN -DARDUINO=100 $flags -I"$TOOLS/host" -I"$LIB" \
+				"$TOOLS/${name%%-*}.cpp" "$LIB/genieArduino.cpp" -o "$OUT/$name" -lm; then
+			FAILED="$FAILED $name"
+			continue
+		fi
+		"$OUT/$name" $args || FAILED="$FAILED $name"
+	done
+
+	if [ -n "$FAILED" ]; then
+		echo "failed:$FAILED" >&2
+		exit 1
+	fi
+}
@@ -0,0 +1,255 @@
+#!/usr/bin/env python3
+#
+# genieProjectGen.py
+#
+#	Read a Workshop4 ViSi-Genie project (.4DGenie) and write a header
+#	of typed object handles for use with genieArduino, eg
+#
+#		genieWriteObject(Form0::Coolgauge0, 50);
+#
+#	along with per-form object lists, object counts and the project's
+#	link settings.
+#
+#	With --config it also writes a genieConfig.h that sizes the
+#	library's value cache and state mirror for the project. It must
+#	go in the genieArduino library folder, beside genieArduino.h, so
+#	the library and the sketch are built with the same sizes.
+#
+#	Usage:	genieProjectGen.py project.4DGenie [output.h] [--config genieConfig.h]
+#
+#	Copyright (c) 2012-2013 4D Systems PTY Ltd, Sydney, Australia
+#	This file is part of genieArduino, see COPYING for the licence.
+#
+
+import os
+import re
+import sys
+
+# Workshop4 section names and the genieArduino object they map to,
+# matched without regard to case. Gauge style widgets are also saved
+# with a leading 'G' (eg GSlider).
+OBJECT_TYPES = {
+	'dipswitch':		'GENIE_OBJ_DIPSW',
+	'knob':				'GENIE_OBJ_KNOB',
+	'rockerswitch':		'GENIE_OBJ_ROCKERSW',
+	'rotaryswitch':		'GENIE_OBJ_ROTARYSW',
+	'slider':			'GENIE_OBJ_SLIDER',
+	'trackbar':			'GENIE_OBJ_TRACKBAR',
+	'winbutton':		'GENIE_OBJ_WINBUTTON',
+	'angularmeter':		'GENIE_OBJ_ANGULAR_METER',
+	'coolgauge':		'GENIE_OBJ_COOL_GAUGE',
+	'customdigits':		'GENIE_OBJ_CUSTOM_DIGITS',
+	'form':				'GENIE_OBJ_FORM',
+	'gauge':			'GENIE_OBJ_GAUGE',
+	'image':			'GENIE_OBJ_IMAGE',
+	'userimages':		'GENIE_OBJ_IMAGE',
+	'keyboard':			'GENIE_OBJ_KEYBOARD',
+	'led':				'GENIE_OBJ_LED',
+	'leddigits':		'GENIE_OBJ_LED_DIGITS',
+	'meter':			'GENIE_OBJ_METER',
+	'strings':			'GENIE_OBJ_STRINGS',
+	'thermometer':		'GENIE_OBJ_THERMOMETER',
+	'userled':			'GENIE_OBJ_USER_LED',
+	'video':			'GENIE_OBJ_VIDEO',
+	'statictext':		'GENIE_OBJ_STATIC_TEXT',
+	'sound':			'GENIE_OBJ_SOUND',
+	'timer':			'GENIE_OBJ_TIMER',
+}
+
+# Sections that are not objects
+NON_OBJECTS = ('depends', 'options')
+
+# Objects the user can change, their values are reported to the host
+INPUTS = ('GENIE_OBJ_DIPSW', 'GENIE_OBJ_KNOB', 'GENIE_OBJ_ROCKERSW', 'GENIE_OBJ_ROTARYSW',
+		  'GENIE_OBJ_SLIDER', 'GENIE_OBJ_TRACKBAR', 'GENIE_OBJ_WINBUTTON', 'GENIE_OBJ_KEYBOARD')
+
+
+def object_type(section):
+	key = section.lower()
+	if key in OBJECT_TYPES:
+		return OBJECT_TYPES[key]
+	if key.startswith('g') and key[1:] in OBJECT_TYPES:
+		return OBJECT_TYPES[key[1:]]
+	return None
+
+
+def parse(path):
+	"""Split the project into (section name, {property: value}) pairs."""
+	sections = []
+	current = None
+
+	with open(path, encoding='utf-8-sig') as f:
+		for line in f:
+			line = line.rstrip('\r\n')
+			if not line.strip():
+				continue
+			if not line[0].isspace():
+				word = line.split()[0]
+				if word == 'end':
+					current = None
+				elif len(line.split()) == 1:
+					current = (word, {})
+					sections.append(current)
+				# else a header line such as 'Platform  uLCD-32PTU'
+				continue
+			if current is not None:
+				parts = line.split(None, 1)
+				current[1][parts[0]] = parts[1].strip() if len(parts) > 1 else ''
+	return sections
+
+
+def identifier(name):
+	name = re.sub(r'\W', '_', name)
+	if name[0].isdigit():
+		name = '_' + name
+	return name
+
+
+def option(options, key, default):
+	value = options.get(key, default)
+	if value in ('Yes', 'No'):
+		return '1' if value == 'Yes' else '0'
+	return value
+
+
+def load(path):
+	"""Returns the project's (options, forms, counts)."""
+	sections = parse(path)
+	options = {}
+	forms = []			# [(name, [(name, type, index)])]
+	counts = {}			# objects of each type, gives the next index
+	skipped = []
+
+	for section, props in sections:
+		if section.lower() == 'options':
+			options = props
+			continue
+		if section.lower() in NON_OBJECTS:
+			continue
+
+		obj = object_type(section)
+		if obj is None:
+			skipped.append(section)
+			continue
+
+		index = counts.get(obj, 0)
+		counts[obj] = index + 1
+		name = identifier(props.get('Name', '%s%d' % (section, index)))
+
+		if obj == 'GENIE_OBJ_FORM':
+			forms.append((name, []))
+		elif not forms:
+			sys.exit('%s: %s before the first Form' % (path, name))
+		else:
+			forms[-1][1].append((name, obj, index))
+
+	for section in sorted(set(skipped)):
+		sys.stderr.write('%s: skipped unknown section %s\n' % (path, section))
+	return options, forms, counts
+
+
+def generate(path, project, out):
+	options, forms, counts = project
+
+	if out is sys.stdout:
+		guard = 'genieProject_h'
+	else:
+		guard = identifier(os.path.splitext(os.path.basename(out.name))[0]) + '_h'
+	n_objects = sum(len(objs) for _, objs in forms)
+	w = out.write
+
+	w('/////////////////////// Generated by genieProjectGen.py ///////////////////////\n')
+	w('//\n')
+	w('//      From %s, do not edit.\n' % os.path.basename(path))
+	w('//      Object handles, counts and link settings for genieArduino.\n')
+	w('//\n\n')
+	w('#ifndef %s\n#define %s\n\n' % (guard, guard))
+	w('#include "genieArduino.h"\n\n')
+
+	w('// Link settings from the project Options\n\n')
+	w('#define\tGENIE_PROJECT_SPEED\t\t\t%s\n' % option(options, 'Speed', '9600'))
+	w('#define\tGENIE_PROJECT_SNDBUF\t\t%s\n' % option(options, 'SndBuf', '0'))
+	w('#define\tGENIE_PROJECT_MULTIDROP\t\t%s\n' % option(options, 'Multidrop', 'No'))
+	w('#define\tGENIE_PROJECT_DESTINATION\t%s\n\n' % option(options, 'Destination', '0'))
+
+	w('// Object counts, forms are not included in GENIE_PROJECT_OBJECTS\n\n')
+	w('#define\tGENIE_PROJECT_FORMS\t\t\t%d\n' % len(forms))
+	w('#define\tGENIE_PROJECT_OBJECTS\t\t%d\n' % n_objects)
+	for obj in sorted(counts):
+		if obj != 'GENIE_OBJ_FORM':
+			w('#define\tGENIE_PROJECT_%s\t%d\n' % (obj[len('GENIE_OBJ_'):], counts[obj]))
+	w('\n')
+
+	for form_index, (form, objs) in enumerate(forms):
+		w('namespace %s {\n' % form)
+		w('\tconstexpr genieObjectHandle\thandle = { GENIE_OBJ_FORM, %d, %d };\n' % (form_index, form_index))
+		for name, obj, index in objs:
+			w('\tconstexpr genieObjectHandle\t%s = { %s, %d, %d };\n' % (name, obj, index, form_index))
+		w('\n\tconstexpr uint8_t\t\t\tobjectCount = %d;\n' % len(objs))
+		if objs:
+			w('\tconstexpr genieObjectHandle\tobjects[] = { %s };\n' % ', '.join(n for n, _, _ in objs))
+		w('}\n\n')
+
+	w('#endif\n')
+
+
+def generate_config(path, project, out):
+	options, forms, counts = project
+	strings = counts.get('GENIE_OBJ_STRINGS', 0)
+	objects = sum(len(objs) for _, objs in forms) - strings
+	inputs = sum(counts.get(obj, 0) for obj in INPUTS)
+	w = out.write
+
+	# a size of 0 would leave out the cache or mirror altogether
+	w('/////////////////////// Generated by genieProjectGen.py ///////////////////////\n')
+	w('//\n')
+	w('//      From %s, do not edit.\n' % os.path.basename(path))
+	w('//      genieArduino table sizes for the project, keep this beside\n')
+	w('//      genieArduino.h so the library and the sketch both use it.\n')
+	w('//\n\n')
+	w('#ifndef genieConfig_h\n#define genieConfig_h\n\n')
+
+	w('// the last value of each input object\n')
+	w('#ifndef MAX_GENIE_CACHE\n')
+	w('#define\tMAX_GENIE_CACHE\t\t\t%d\n' % min(max(inputs, 1), 255))
+	w('#endif\n\n')
+
+	w('// every object and string written, the mirror can\'t be used with multidrop\n')
+	w('#if !defined(MAX_GENIE_MIRROR) && !defined(GENIE_MULTIDROP)\n')
+	w('#define\tMAX_GENIE_MIRROR\t\t%d\n' % min(max(objects, 1), 255))
+	w('#endif\n')
+	w('#ifndef MAX_GENIE_MIRROR_STRS\n')
+	w('#define\tMAX_GENIE_MIRROR_STRS\t%d\n' % min(strings, 255))
+	w('#endif\n\n')
+
+	w('#endif\n')
+
+
+def main():
+	args = sys.argv[1:]
+	config = None
+
+	if '--config' in args:
+		i = args.index('--config')
+		if i + 1 >= len(args):
+			sys.exit('--config needs a file name')
+		config = args[i + 1]
+		del args[i:i + 2]
+
+	if len(args) not in (1, 2):
+		sys.exit('Usage: %s project.4DGenie [output.h] [--config genieConfig.h]' % sys.argv[0])
+
+	project = load(args[0])
+	if len(args) == 2:
+		with open(args[1], 'w', newline='\n') as out:
+			generate(args[0], project, out)
+	else:
+		generate(args[0], project, sys.stdout)
+
+	if config is not None:
+		with open(config, 'w', newline='\n') as out:
+			generate_config(args[0], project, out)
+
+
+if __name__ == '__main__':
+	main()
@@ -0,0 +1,189 @@
+/////////////////////////// genieQueueSizer ///////////////////////////
+//
+//      Replay an event rate profile through genieDoEvents() on a PC,
+//      with simulated time, and print how the event queue coped.
+//      Built and run for each queue depth by genieQueueSizer.sh.
+//
+//      Usage:	genieQueueSizer [-b baud] [-r rx buffer] profile [trials [seed]]
+//
+//      Events take their time on the wire at the baud rate, default
+//      115200, and wait in a receive buffer of the given size, by 
+//      default SERIAL_RX_BUFFER_SIZE as on the Arduino AVR core, until
+//      genieDoEvents() reads them. Frames that don't fit are lost in
+//      the UART before the event queue sees them, as they would be.
+//
+//      Each line of the profile is one phase of the sketch's life
+//
+//		<mS> <events per second> <loop mS> [<events per handler call>]
+//
+//      where loop mS is how long the sketch spends between calls to
+//      genieDoEvents() and the handler takes all the queued events
+//      unless a number is given. Events arrive at random times at
+//      the given average rate. Blank lines and # comments are ignored.
+//
+//      Output:	<depth> <events> <drops> <UART lost> <high water> <mS above threshold>
+//
+//      drops are events the full queue turned away, UART lost those
+//      that never made it out of the receive buffer.
+//
+//      Copyright (c) 2012-2013 4D Systems PTY Ltd, Sydney, Australia
+//      This file is part of genieArduino, see COPYING for the licence.
+//
+
+#include "genieHostLink.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#ifndef GENIE_QUEUE_STATS
+#error "build with -DGENIE_QUEUE_STATS"
+#endif
+
+#define	MAX_PHASES		64
+
+static HostLink		_link;
+static HostDisplay *_display;
+static uint64_t		_sent = 0;		// events the display sent
+static uint64_t		_handled = 0;	// events the handler took
+
+struct phaseStruct {
+	uint32_t	ms;
+	double		rate;
+	uint32_t	loop_ms;
+	uint32_t	per_call;
+};
+
+static phaseStruct	_phases[MAX_PHASES];
+static int			_nPhases = 0;
+static uint32_t		_perCall = 0;
+
+////////////////////// handler ///////////////////////////////
+//
+// Take up to _perCall events, or all of them
+//
+static void handler (void) {
+	genieFrame f;
+	uint32_t n = 0;
+
+	while ((_perCall == 0 || n < _perCall) && genieDequeueEvent(&f))
+		n++;
+	_handled += n;
+}
+
+////////////////////// doEvents //////////////////////////////
+//
+// Call genieDoEvents() until it has read everything waiting
+//
+static void doEvents (void) {
+	while (genieDoEvents() == GENIE_EVENT_RXCHAR)
+		;
+}
+
+////////////////////// nextArrival ///////////////////////////
+//
+// Returns:	uS until the next event at the given average rate
+//
+static uint64_t nextArrival (double rate) {
+	double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+
+	return (uint64_t)(-log(u) / rate * 1e6);
+}
+
+////////////////////// readProfile ///////////////////////////
+//
+static bool readProfile (const char * name) {
+	FILE * f = fopen(name, "r");
+	char line[128];
+	phaseStruct p;
+
+	if (f == NULL)
+		return false;
+
+	while (fgets(line, sizeof(line), f) != NULL && _nPhases < MAX_PHASES) {
+		p.per_call = 0;
+		if (sscanf(line, "%u %lf %u %u", &p.ms, &p.rate, &p.loop_ms, &p.per_call) >= 3)
+			_phases[_nPhases++] = p;
+	}
+	fclose(f);
+	return _nPhases > 0;
+}
+
+////////////////////// runTrial //////////////////////////////
+//
+// Replay the whole profile once
+//
+static void runTrial (void) {
+	uint64_t end = hostNow;
+	uint64_t arrival, next;
+	int i;
+
+	for (i = 0; i < _nPhases; i++) {
+		phaseStruct * p = &_phases[i];
+
+		_perCall = p->per_call;
+		end += (uint64_t)p->ms * 1000;
+		arrival = (p->rate > 0) ? hostNow + nextArrival(p->rate) : end;
+
+		while (hostNow < end) {
+			doEvents();
+
+			// the sketch is busy, events are sent when they happen
+			next = hostNow + (uint64_t)(p->loop_ms ? p->loop_ms : 1) * 1000;
+			while (arrival <= next && arrival < end) {
+				hostNow = arrival;
+				_link.sendEvent(_display, GENIE_OBJ_SLIDER, i, 0);
+				_sent++;
+				arrival += nextArrival(p->rate);
+			}
+			hostNow = next;
+		}
+	}
+
+	// let the sketch catch up
+	_perCall = 0;
+	do {
+		hostNow += 1000;
+		doEvents();
+	} while (_link.pending() > 0);
+}
+
+int main (int argc, char ** argv) {
+	genieQueueStatsStruct stats;
+	uint32_t baud = 115200;
+	int trials = 10;
+	int i;
+
+	while ((i = getopt(argc, argv, "b:r:")) != -1) {
+		switch (i) {
+			case 'b':	baud = atoi(optarg);		break;
+			case 'r':	_link.rx_size = atoi(optarg);	break;
+			default:	argc = 0;					break;
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc < 1 || baud == 0 || _link.rx_size == 0 || !readProfile(argv[0])) {
+		fprintf(stderr, "usage: genieQueueSizer [-b baud] [-r rx buffer] profile [trials [seed]]\n");
+		return 1;
+	}
+	if (argc > 1)
+		trials = atoi(argv[1]);
+	srand(argc > 2 ? atoi(argv[2]) : 1);
+
+	_link.byte_us = 10000000UL / baud;	// start, 8 data and stop bits
+	_display = _link.addDisplay(0);
+	genieBegin(_link);
+	genieAttachEventHandler(handler);
+
+	for (i = 0; i < trials; i++)
+		runTrial();
+
+	genieGetQueueStats(&stats);
+	printf("%u %lu %lu %lu %u %lu\n", MAX_GENIE_EVENTS, (unsigned long)_sent,
+		   (unsigned long)stats.overflows, (unsigned long)(_sent - _handled - stats.overflows),
+		   stats.high_water, (unsigned long)stats.above_ms);
+	return 0;
+}
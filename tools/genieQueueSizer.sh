@@ -0,0 +1,99 @@
+#!/bin/sh
+#
+# genieQueueSizer.sh
+#
+#	Find the smallest MAX_GENIE_EVENTS that keeps the chance of an 
+#	event being dropped below a target, by replaying an event rate
+#	profile through genieDoEvents() on this PC with each queue depth
+#	in turn. See genieQueueSizer.cpp for the profile format.
+#
+#	Usage:	genieQueueSizer.sh [-b baud] [-r rx buffer] profile [target [trials]]
+#
+#	target is the acceptable fraction of events dropped, default 
+#	0.001, trials the number of times the profile is replayed, 
+#	default 10. The baud rate, default 115200, and the size of the
+#	serial receive buffer, default that of the Arduino AVR core, are
+#	those of the sketch. Events lost because the receive buffer 
+#	overflowed count as dropped, a deeper queue can't save them.
+#	If no depth meets the target the two losses are each compared
+#	with it, the larger first, and the exit status is 2.
+#
+#	Copyright (c) 2012-2013 4D Systems PTY Ltd, Sydney, Australia
+#	This file is part of genieArduino, see COPYING for the licence.
+#
+
+CXX=${CXX:-c++}
+
+USAGE="usage: $0 [-b baud] [-r rx buffer] profile [target [trials]]"
+SIZER_OPTS=""
+while getopts b:r: opt; do
+	case $opt in
+		b|r)	SIZER_OPTS="$SIZER_OPTS -$opt $OPTARG" ;;
+		*)		echo "$USAGE" >&2; exit 1 ;;
+	esac
+done
+shift $((OPTIND - 1))
+
+if [ $# -lt 1 ]; then
+	echo "$USAGE" >&2
+	exit 1
+fi
+
+PROFILE=$1
+TARGET=${2:-0.001}
+TRIALS=${3:-10}
+
+TOOLS=$(cd "$(dirname "$0")" && pwd)
+LIB="$TOOLS/../genieArduino"
+OUT=$(mktemp -d)
+trap 'rm -rf "$OUT"' EXIT
+
+printf "%6s %10s %8s %10s %10s %6s %10s\n" depth events drops uart-lost drop-rate high above-mS
+BEST=""
+for depth in 4 8 16 32 64 128; do
+	if ! $CXX -O2 -DARDUINO=100 -DGENIE_QUEUE_STATS -DGENIE_NO_LINK_MONITOR -DMAX_GENIE_EVENTS=$depth \
+			-I"$TOOLS/host" -I"$LIB" "$TOOLS/genieQueueSizer.cpp" "$LIB/genieArduino.cpp" \
+			-o "$OUT/sizer" -lm; then
+		echo "failed to build for depth $depth" >&2
+		exit 1
+	fi
+	RESULT=$("$OUT/sizer" $SIZER_OPTS "$PROFILE" "$TRIALS")
+	if [ $? -ne 0 ] || [ -z "$RESULT" ]; then
+		echo "the sizer failed for depth $depth" >&2
+		exit 1
+	fi
+	set -- $RESULT
+	RATE=$(awk -v e="$2" -v d="$3" -v u="$4" 'BEGIN { printf "%.6f", (e > 0) ? (d + u) / e : 0 }')
+	printf "%6s %10s %8s %10s %10s %6s %10s\n" "$1" "$2" "$3" "$4" "$RATE" "$5" "$6"
+	EVENTS=$2
+	DROPS=$3
+	UART=$4
+	if [ -z "$BEST" ] && awk -v r="$RATE" -v t="$TARGET" 'BEGIN { exit !(r <= t) }'; then
+		BEST=$depth
+	fi
+done
+
+if [ -n "$BEST" ]; then
+	echo "MAX_GENIE_EVENTS $BEST keeps drops at or below $TARGET"
+	exit 0
+fi
+
+# Say where the events were lost with the deepest queue tried, the
+# larger loss first and the other only if it misses the target too
+echo "no depth tried keeps drops at or below $TARGET, at depth $depth" >&2
+awk -v e="$EVENTS" -v d="$DROPS" -v u="$UART" -v t="$TARGET" 'BEGIN {
+	queue = (e > 0) ? d / e : 0
+	uart = (e > 0) ? u / e : 0
+	q = sprintf("%10.6f dropped by the full queue, the handler must take events faster", queue)
+	r = sprintf("%10.6f lost in the serial receive buffer, call genieDoEvents() more often or use GENIE_RX_INTERRUPT", uart)
+	if (uart > queue) {
+		print r
+		if (queue > t)
+			print q
+	} else {
+		print q
+		if (uart > t)
+			print r
+	}
+}' >&2
+exit 2
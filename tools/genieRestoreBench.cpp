@@ -0,0 +1,129 @@
+/////////////////////// genieRestoreBench ///////////////////////
+//
+//      Time genieRestoreState() replaying a typical panel to a
+//      display that has restarted: 50 widgets over three forms,
+//      two strings, the contrast and the active form. The link is
+//      simulated at each baud rate, with the display taking a set
+//      time over each command, and the display is checked to show
+//      the panel again afterwards.
+//
+//      Usage:	genieRestoreBench [display uS per command]
+//
+//      Output:	<baud> <frames> <bytes> <replay mS>
+//
+//      Build with -DMAX_GENIE_MIRROR=64, see genieHostTests.sh.
+//
+//      Copyright (c) 2012-2013 4D Systems PTY Ltd, Sydney, Australia
+//      This file is part of genieArduino, see COPYING for the licence.
+//
+
+#include "genieHostLink.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#if MAX_GENIE_MIRROR < 50
+#error "build with -DMAX_GENIE_MIRROR=64"
+#endif
+
+#define	WIDGETS		50
+
+static HostLink	_link;
+
+// the panel: widget types, the form each is on and the strings
+static const uint8_t _types[] = {
+	GENIE_OBJ_COOL_GAUGE, GENIE_OBJ_LED_DIGITS, GENIE_OBJ_LED, GENIE_OBJ_SLIDER,
+	GENIE_OBJ_METER, GENIE_OBJ_GAUGE, GENIE_OBJ_USER_LED, GENIE_OBJ_ANGULAR_METER
+};
+static const char * _strings[] = { "Pump 1 running", "Tank 82%" };
+
+////////////////////// widgetForm ////////////////////////////
+//
+// 20 widgets on Form0 and 15 on each of Form1 and Form2
+//
+static uint8_t widgetForm (uint8_t w) {
+	return (w < 20) ? 0 : (w < 35) ? 1 : 2;
+}
+
+////////////////////// writePanel ////////////////////////////
+//
+// Show the panel, finishing on Form1
+//
+static void writePanel (void) {
+	uint8_t form = 0xFF;
+	uint8_t w;
+
+	for (w = 0; w < WIDGETS; w++) {
+		if (widgetForm(w) != form) {
+			form = widgetForm(w);
+			genieWriteObject(GENIE_OBJ_FORM, form, 0);
+		}
+		genieWriteObject(_types[w % sizeof(_types)], w, w * 37);
+	}
+	genieWriteStr(0, (char *)_strings[0]);
+	genieWriteStr(1, (char *)_strings[1]);
+	genieWriteContrast(12);
+	genieWriteObject(GENIE_OBJ_FORM, 1, 0);
+}
+
+////////////////////// panelShown ////////////////////////////
+//
+// Returns:	TRUE if the display shows the whole panel
+//
+static bool panelShown (HostDisplay * d) {
+	uint8_t w;
+
+	for (w = 0; w < WIDGETS; w++) {
+		if (d->values[(_types[w % sizeof(_types)] << 8) | w] != w * 37)
+			return FALSE;
+	}
+	return d->form == 1 && d->contrast == 12 &&
+		   d->strings[0] == _strings[0] && d->strings[1] == _strings[1];
+}
+
+int main (int argc, char ** argv) {
+	uint32_t bauds[] = { 9600, 38400, 115200, 200000, 600000 };
+	uint32_t reply_us = (argc > 1) ? atoi(argv[1]) : 250;
+	bool ok = TRUE;
+	uint8_t i;
+
+	printf("display takes %u uS per command\n", reply_us);
+	printf("%7s %7s %7s %10s\n", "baud", "frames", "bytes", "replay mS");
+	for (i = 0; i < sizeof(bauds) / sizeof(bauds[0]); i++) {
+		HostDisplay * d;
+		uint64_t start;
+		uint32_t ms;
+		size_t bytes = 0;
+
+		_link = HostLink();
+		_link.byte_us = 10000000UL / bauds[i];	// start, 8 data and stop bits
+		_link.reply_us = reply_us;
+		_link.poll_us = 10;
+		d = _link.addDisplay(0);
+
+		genieBegin(_link);
+		genieSetLinkHealth(MAX_GENIE_FATALS, 0, PROBE_PERIOD);
+		writePanel();
+
+		// the display restarts, blank and on Form0
+		d->values.clear();
+		d->strings.clear();
+		d->commands.clear();
+		d->form = 0;
+		d->contrast = -1;
+
+		start = hostNow;
+		ms = genieRestoreState();
+
+		for (size_t c = 0; c < d->commands.size(); c++)
+			bytes += d->commands[c].size();
+		printf("%7u %7u %7u %10.1f\n", bauds[i], (unsigned)d->commands.size(),
+			   (unsigned)bytes, (hostNow - start) / 1000.0);
+
+		if (!panelShown(d) || ms + 1 < (hostNow - start) / 1000) {
+			printf("FAIL the panel was not restored at %u baud\n", bauds[i]);
+			ok = FALSE;
+		}
+	}
+	return ok ? 0 : 1;
+}
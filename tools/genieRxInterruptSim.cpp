@@ -0,0 +1,135 @@
+/////////////////////// genieRxInterruptSim ///////////////////////
+//
+//      Simulate a sketch whose loop() is slow, eg busy writing to an
+//      SD card, while the display sends a steady stream of events.
+//      Built with GENIE_RX_INTERRUPT a timer interrupt calls
+//      genieRxInterrupt() every tick and no frame may be lost. Built
+//      without, characters are only read when loop() calls
+//      genieDoEvents() and the 64 byte Rx buffer overflows while it
+//      is busy, which is what the interrupt is for.
+//
+//      Usage:	genieRxInterruptSim [events/s [busy mS [seconds]]]
+//
+//      Each event carries its sequence number so a lost frame is
+//      seen as a gap. Time is simulated, apart from the uS reported
+//      by genieGetRxMaxTime() which are this PC's.
+//
+//      Build with -DGENIE_QUEUE_STATS, -DGENIE_NO_LINK_MONITOR and
+//      -DMAX_GENIE_EVENTS=32 so the event queue holds what arrives
+//      while loop() is busy, see genieHostTests.sh.
+//
+//      Copyright (c) 2012-2013 4D Systems PTY Ltd, Sydney, Australia
+//      This file is part of genieArduino, see COPYING for the licence.
+//
+
+#define	HOST_OWN_CLOCK
+#include "genieHostLink.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#ifndef GENIE_QUEUE_STATS
+#error "build with -DGENIE_QUEUE_STATS"
+#endif
+
+#define	BAUD		115200
+#define	TICK_US		1000	// timer interrupt period
+
+static HostLink		_link;
+static HostDisplay *_display;
+static uint16_t		_next = 0;		// sequence number expected next
+static uint32_t		_handled = 0;
+static uint32_t		_gaps = 0;		// events missing
+
+unsigned long millis (void) {
+	return (unsigned long)(hostNow / 1000);
+}
+
+unsigned long micros (void) {
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1000000UL + t.tv_nsec / 1000;
+}
+
+////////////////////// handler ///////////////////////////////
+//
+static void handler (void) {
+	genieFrame f;
+
+	while (genieDequeueEvent(&f)) {
+		uint16_t seq = genieGetEventData(&f);
+
+		_gaps += (uint16_t)(seq - _next);
+		_next = seq + 1;
+		_handled++;
+	}
+}
+
+////////////////////// tick //////////////////////////////////
+//
+// One timer interrupt period passes
+//
+static void tick (void) {
+	hostNow += TICK_US;
+#ifdef GENIE_RX_INTERRUPT
+	genieRxInterrupt();
+#endif
+}
+
+int main (int argc, char ** argv) {
+	uint32_t rate = (argc > 1) ? atoi(argv[1]) : 100;
+	uint32_t busy_ms = (argc > 2) ? atoi(argv[2]) : 250;
+	uint32_t seconds = (argc > 3) ? atoi(argv[3]) : 60;
+	uint64_t end = (uint64_t)seconds * 1000000;
+	uint64_t period = 1000000 / rate;
+	uint64_t next_event = period;
+	uint16_t sent = 0;
+	uint32_t t;
+	genieQueueStatsStruct stats;
+
+	_link.byte_us = 10000000UL / BAUD;
+	_display = _link.addDisplay(0);
+	genieBegin(_link);
+	genieAttachEventHandler(handler);
+
+	while (hostNow < end) {
+		// loop(), genieDoEvents() until it is idle then busy
+		while (genieDoEvents() == GENIE_EVENT_RXCHAR)
+			;
+		for (t = 0; t < busy_ms * 1000; t += TICK_US) {
+			tick();
+			if (hostNow >= next_event && hostNow < end) {
+				_link.sendEvent(_display, GENIE_OBJ_WINBUTTON, 0, sent++);
+				next_event += period;
+			}
+		}
+	}
+
+	// let everything arrive and be handled
+	for (t = 0; t < 1000 && (_link.pending() > 0 || _handled < sent); t++) {
+		tick();
+		while (genieDoEvents() == GENIE_EVENT_RXCHAR)
+			;
+	}
+
+	genieGetQueueStats(&stats);
+#ifdef GENIE_RX_INTERRUPT
+	printf("Rx interrupt every %u uS, loop() busy %u mS, %u events/s\n", TICK_US, busy_ms, rate);
+#else
+	printf("Rx polled by loop(), loop() busy %u mS, %u events/s\n", busy_ms, rate);
+#endif
+	printf("sent %u handled %u lost %u, Rx buffer overflows %u chars, queue overflows %u, high water %u/%u\n",
+		   sent, _handled, sent - _handled, _link.rx_overflows, stats.overflows,
+		   stats.high_water, MAX_GENIE_EVENTS - 2);
+
+#ifdef GENIE_RX_INTERRUPT
+	printf("longest genieRxInterrupt() per character %u uS on this PC\n", genieGetRxMaxTime());
+	if (_handled != sent || _gaps != 0 || _link.rx_overflows != 0 || stats.overflows != 0) {
+		printf("FAIL frames were lost\n");
+		return 1;
+	}
+#endif
+	return 0;
+}
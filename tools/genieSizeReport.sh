@@ -0,0 +1,154 @@
+#!/bin/sh
+#
+# genieSizeReport.sh
+#
+#	Link a minimal sketch against genieArduino and the Arduino core
+#	once for each build profile, with unused sections discarded as
+#	the Arduino IDE does, and print the size of its .text, .data and
+#	.bss sections from avr-size -A, so the cost of a change can be 
+#	seen on a small AVR before it is committed. Flash is .text plus
+#	.data, RAM is .data plus .bss. The library columns are what the
+#	sketch takes over the same sketch using Serial alone.
+#
+#	Usage:	genieSizeReport.sh [extra compiler flags]
+#
+#	ARDUINO_AVR must point at the Arduino AVR core, the directory
+#	holding cores/ and variants/, eg
+#
+#		ARDUINO_AVR=~/.arduino15/packages/arduino/hardware/avr/1.8.6
+#
+#	MCU and VARIANT select the board, the default is an Uno
+#	(atmega328p, standard), use atmega2560 and mega for a Mega.
+#	CC, CXX, SIZE and ARCH_FLAGS override the toolchain.
+#
+#	Copyright (c) 2012-2013 4D Systems PTY Ltd, Sydney, Australia
+#	This file is part of genieArduino, see COPYING for the licence.
+#
+
+MCU=${MCU:-atmega328p}
+VARIANT=${VARIANT:-standard}
+F_CPU=${F_CPU:-16000000L}
+CC=${CC:-avr-gcc}
+CXX=${CXX:-avr-g++}
+SIZE=${SIZE:-avr-size}
+ARCH_FLAGS=${ARCH_FLAGS:--mmcu=$MCU -DF_CPU=$F_CPU -DARDUINO=10800 -DARDUINO_ARCH_AVR}
+EXTRA="$*"
+
+if [ -z "$ARDUINO_AVR" ] || [ ! -d "$ARDUINO_AVR/cores/arduino" ]; then
+	echo "ARDUINO_AVR must point at the Arduino AVR core" >&2
+	exit 1
+fi
+
+CORE="$ARDUINO_AVR/cores/arduino"
+LIB=$(cd "$(dirname "$0")/../genieArduino" && pwd)
+OUT=$(mktemp -d)
+trap 'rm -rf "$OUT"' EXIT
+
+CFLAGS="-Os $ARCH_FLAGS -ffunction-sections -fdata-sections -I$CORE -I$ARDUINO_AVR/variants/$VARIANT"
+CXXFLAGS="$CFLAGS -fno-exceptions -fno-threadsafe-statics"
+LDFLAGS="-Os $ARCH_FLAGS -Wl,--gc-sections"
+
+# name and flags of each profile
+PROFILES="
+default:
+no-strings:-DGENIE_NO_STRINGS
+no-monitor:-DGENIE_NO_LINK_MONITOR
+tables:-DMAX_GENIE_FILTERS=4 -DMAX_GENIE_CACHE=8 -DMAX_GENIE_MIRROR=16
+small:-DGENIE_PROFILE_SMALL
+write-only:-DGENIE_WRITE_ONLY
+minimal:-DGENIE_PROFILE_MINIMAL
+"
+
+# The sketch: SKETCH_GENIE uses the library as a sketch would at
+# the least, without it the sketch just opens Serial
+cat > "$OUT/sketch.cpp" <<'SKETCH'
+#include <Arduino.h>
+#include <genieArduino.h>
+
+#if defined(SKETCH_GENIE) && !defined(GENIE_WRITE_ONLY)
+static void handler (void) {
+	genieFrame f;
+
+	while (genieDequeueEvent(&f))
+		;
+}
+#endif
+
+void setup (void) {
+#ifdef SKETCH_GENIE
+	genieBegin(GENIE_SERIAL, 115200);
+#ifndef GENIE_WRITE_ONLY
+	genieAttachEventHandler(handler);
+#endif
+	genieWriteObject(GENIE_OBJ_LED, 0, 1);
+#ifndef GENIE_NO_STRINGS
+	genieWriteStr(0, (char *)"genie");
+#endif
+#else
+	Serial.begin(115200);
+#endif
+}
+
+void loop (void) {
+#ifdef SKETCH_GENIE
+	genieDoEvents();
+#endif
+}
+SKETCH
+
+# The core, once
+mkdir "$OUT/core"
+for src in "$CORE"/*.c "$CORE"/*.cpp "$CORE"/*.S; do
+	[ -f "$src" ] || continue
+	obj="$OUT/core/$(basename "$src").o"
+	case "$src" in
+		*.cpp)	$CXX -c $CXXFLAGS "$src" -o "$obj" ;;
+		*.S)	$CC -c -x assembler-with-cpp $CFLAGS "$src" -o "$obj" ;;
+		*)		$CC -c $CFLAGS "$src" -o "$obj" ;;
+	esac || { echo "the core failed to compile" >&2; exit 1; }
+done
+ar rcs "$OUT/core.a" "$OUT"/core/*.o
+
+# link: name, flags, the sketch with or without the library
+link() {
+	if ! $CXX -c $CXXFLAGS -I"$LIB" $2 "$OUT/sketch.cpp" -o "$OUT/$1.sketch.o"; then
+		echo "$1 failed to compile" >&2
+		return 1
+	fi
+	objs="$OUT/$1.sketch.o"
+	if [ "$3" = genie ]; then
+		if ! $CXX -c $CXXFLAGS -I"$LIB" $2 "$LIB/genieArduino.cpp" -o "$OUT/$1.o"; then
+			echo "$1 failed to compile" >&2
+			return 1
+		fi
+		objs="$objs $OUT/$1.o"
+	fi
+	$CXX $LDFLAGS $objs "$OUT/core.a" -o "$OUT/$1.elf" || { echo "$1 failed to link" >&2; return 1; }
+}
+
+# prints the size of the .text, .data and .bss sections
+sizes() {
+	$SIZE -A "$OUT/$1.elf" | awk '
+		$1 == ".text"	{ text = $2 }
+		$1 == ".data"	{ data = $2 }
+		$1 == ".bss"	{ bss = $2 }
+		END				{ print text + 0, data + 0, bss + 0 }'
+}
+
+link baseline "$EXTRA" serial || exit 1
+set -- $(sizes baseline)
+BASE_TEXT=$1
+BASE_DATA=$2
+BASE_BSS=$3
+
+printf "%-12s %7s %7s %7s %9s %9s %9s\n" profile .text .data .bss "lib .text" "lib .data" "lib .bss"
+printf "%-12s %7d %7d %7d\n" serial-only $BASE_TEXT $BASE_DATA $BASE_BSS
+echo "$PROFILES" | while IFS=: read -r name flags; do
+	[ -z "$name" ] && continue
+	link "$name" "-DSKETCH_GENIE $flags $EXTRA" genie || exit 1
+	sizes "$name" | {
+		read -r text data bss
+		printf "%-12s %7d %7d %7d %9d %9d %9d\n" "$name" $text $data $bss \
+			$((text - BASE_TEXT)) $((data - BASE_DATA)) $((bss - BASE_BSS))
+	}
+done
@@ -0,0 +1,45 @@
+/////////////////////////// Arduino.h (host) ///////////////////////////
+//
+//      Just enough of the Arduino core to build genieArduino on a
+//      PC for the host tools, time is simulated by the tool.
+//
+//      Copyright (c) 2012-2013 4D Systems PTY Ltd, Sydney, Australia
+//      This file is part of genieArduino, see COPYING for the licence.
+//
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define	lowByte(w)		((uint8_t)((w) & 0xFF))
+#define	highByte(w)		((uint8_t)((w) >> 8))
+
+unsigned long	millis			(void);
+unsigned long	micros			(void);
+
+inline void		noInterrupts	(void) {}
+inline void		interrupts		(void) {}
+
+class Stream {
+  public:
+	virtual size_t	write		(uint8_t c) = 0;
+	virtual size_t	write		(const uint8_t * buf, size_t len) {
+		size_t n = 0;
+		while (len--)
+			n += write(*buf++);
+		return n;
+	}
+	virtual int		available	(void) = 0;
+	virtual int		read		(void) = 0;
+	size_t			readBytes	(char * buf, size_t len) {
+		size_t n = 0;
+		while (n < len && available() > 0)
+			buf[n++] = read();
+		return n;
+	}
+};
+
+#endif
@@ -0,0 +1,294 @@
+/////////////////////////// genieHostLink.h ///////////////////////////
+//
+//      The far end of the serial link for the host tools: one or
+//      more virtual displays that answer genieArduino's commands the
+//      way a ViSi-Genie display does, with the time characters take
+//      on the wire and the host's limited receive buffer modelled.
+//
+//      Time is simulated, hostNow is in uS and only moves when the
+//      tool advances it, when the host sends a character (byte_us)
+//      or when the host finds nothing to read (poll_us). Unless
+//      HOST_OWN_CLOCK is defined millis() and micros() are defined
+//      here from hostNow, so include this in one file only.
+//
+//      Copyright (c) 2012-2013 4D Systems PTY Ltd, Sydney, Australia
+//      This file is part of genieArduino, see COPYING for the licence.
+//
+
+#ifndef genieHostLink_h
+#define genieHostLink_h
+
+#include "Arduino.h"
+#include "genieArduino.h"
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#ifndef SERIAL_RX_BUFFER_SIZE
+#define	SERIAL_RX_BUFFER_SIZE	64		// as the Arduino AVR core
+#endif
+
+#define	MAX_HOST_DISPLAYS		8
+#define	MAX_HOST_COMMAND		(3 + 255 + 1)	// the longest string write
+
+uint64_t hostNow = 0;
+
+#ifndef HOST_OWN_CLOCK
+unsigned long millis (void) {
+	return (unsigned long)(hostNow / 1000);
+}
+
+unsigned long micros (void) {
+	return (unsigned long)hostNow;
+}
+#endif
+
+//////////////////////////////////////////////////////////////
+// One display, what has been written to it and what it has
+// been sent
+//
+struct HostDisplay {
+	uint8_t		address;	// with multidrop
+	bool		alive;		// a display that isn't answers nothing
+	uint8_t		form;		// the active form
+	int16_t		contrast;	// -1 until written
+	std::map<uint16_t, uint16_t>	values;		// object << 8 | index to value
+	std::map<uint8_t, std::string>	strings;	// string index to text
+	std::vector< std::vector<uint8_t> >	commands;	// every good command, without the address
+	uint32_t	naks;		// commands with a bad checksum
+	uint32_t	addressed;	// commands sent to it, answered or not
+	uint64_t	busy;		// when it has finished the commands it has been sent
+};
+
+class HostLink : public Stream {
+  public:
+	uint32_t	byte_us;		// time to send one character, 0 for none
+	uint32_t	reply_us;		// time a display takes to answer a command
+	uint32_t	poll_us;		// time that passes when the host finds nothing to read
+	uint16_t	rx_size;		// the host's receive buffer
+	bool		multidrop;		// every transmission starts with a display address
+	uint32_t	rx_overflows;	// characters lost because the receive buffer was full
+	HostDisplay	displays[MAX_HOST_DISPLAYS];
+	uint8_t		n_displays;
+
+	HostLink () : byte_us(0), reply_us(0), poll_us(0), rx_size(SERIAL_RX_BUFFER_SIZE),
+				  multidrop(false), rx_overflows(0), n_displays(0), _wire_free(0),
+				  _n(0), _to(NULL), _addressed(false) {}
+
+	//////////////////////////////////////////////////////
+	// Add a display, the address is only used with multidrop
+	//
+	HostDisplay * addDisplay (uint8_t address) {
+		HostDisplay * d = &displays[n_displays++];
+
+		d->address = address;
+		d->alive = true;
+		d->form = 0;
+		d->contrast = -1;
+		d->naks = 0;
+		d->addressed = 0;
+		d->busy = 0;
+		return d;
+	}
+
+	//////////////////////////////////////////////////////
+	// Characters that have arrived but not been read, and
+	// any still on their way
+	//
+	size_t pending (void) {
+		return _rx.size() + _wire.size();
+	}
+
+	//////////////////////////////////////////////////////
+	// A display reports an event, it starts now or as soon as
+	// the wire is free
+	//
+	void sendEvent (HostDisplay * d, uint8_t object, uint8_t index, uint16_t value) {
+		_sendFrame(d, GENIE_REPORT_EVENT, object, index, value);
+	}
+
+	//////////////////////////////////////////////////////
+	// A display sends an object report nobody asked it for,
+	// eg a late reply
+	//
+	void sendReport (HostDisplay * d, uint8_t object, uint8_t index, uint16_t value) {
+		_sendFrame(d, GENIE_REPORT_OBJ, object, index, value);
+	}
+
+	//////////////////////////////////////////////////////
+	// Stream
+	//
+	int available (void) {
+		_pump();
+		if (_rx.empty() && poll_us != 0) {
+			hostNow += poll_us;
+			_pump();
+		}
+		return _rx.size();
+	}
+
+	int read (void) {
+		int c;
+
+		_pump();
+		if (_rx.empty())
+			return -1;
+		c = _rx.front();
+		_rx.pop_front();
+		return c;
+	}
+
+	size_t write (uint8_t c) {
+		hostNow += byte_us;
+
+		if (multidrop && !_addressed) {
+			_to = NULL;
+			for (uint8_t i = 0; i < n_displays; i++) {
+				if (displays[i].address == c)
+					_to = &displays[i];
+			}
+			_addressed = true;
+			return 1;
+		}
+		if (!multidrop)
+			_to = &displays[0];
+
+		_cmd[_n++] = c;
+		if (_n == _length()) {
+			_command();
+			_n = 0;
+			_addressed = false;
+		} else if (_length() == 0) {
+			_n = 0;		// not a command, start again
+			_addressed = false;
+		}
+		return 1;
+	}
+
+	using Stream::write;
+
+  private:
+	std::deque< std::pair<uint64_t, uint8_t> >	_wire;	// on its way to the host, and when it arrives
+	std::deque<uint8_t>	_rx;						// the host's receive buffer
+	uint64_t		_wire_free;						// when the displays can next send
+	uint8_t			_cmd[MAX_HOST_COMMAND];			// the command being received
+	uint16_t		_n;
+	HostDisplay *	_to;							// the display it is for
+	bool			_addressed;
+
+	//////////////////////////////////////////////////////
+	// Length of the command being received, 0 if it isn't one
+	// and 1 until the length is known
+	//
+	uint16_t _length (void) {
+		switch (_cmd[0]) {
+			case GENIE_READ_OBJ:		return 4;
+			case GENIE_WRITE_OBJ:		return GENIE_FRAME_SIZE;
+			case GENIE_WRITE_CONTRAST:	return 3;
+			case GENIE_WRITE_STR:
+			case GENIE_WRITE_STRU:		return (_n < 3) ? MAX_HOST_COMMAND : 3 + _cmd[2] + 1;
+			default:					return 0;
+		}
+	}
+
+	void _sendFrame (HostDisplay * d, uint8_t cmd, uint8_t object, uint8_t index, uint16_t value) {
+		uint8_t frame[GENIE_FRAME_SIZE] = { cmd, object, index, highByte(value), lowByte(value), 0 };
+		_send(d, frame, GENIE_FRAME_SIZE, hostNow);
+	}
+
+	//////////////////////////////////////////////////////
+	// Queue a transmission from a display, the address first
+	// with multidrop, a checksum is added to frames
+	//
+	void _send (HostDisplay * d, const uint8_t * data, uint8_t len, uint64_t when) {
+		uint8_t checksum = 0;
+
+		if (when < _wire_free)
+			when = _wire_free;
+		if (multidrop)
+			_wire.push_back(std::make_pair(when += byte_us, d->address));
+		for (uint8_t i = 0; i < len; i++) {
+			uint8_t c = data[i];
+			if (len > 1 && i == len - 1)
+				c = checksum;
+			checksum ^= c;
+			_wire.push_back(std::make_pair(when += byte_us, c));
+		}
+		_wire_free = when;
+	}
+
+	//////////////////////////////////////////////////////
+	// Move what has arrived into the receive buffer, anything
+	// that doesn't fit is lost as it would be in the UART
+	//
+	void _pump (void) {
+		while (!_wire.empty() && _wire.front().first <= hostNow) {
+			if (_rx.size() < rx_size)
+				_rx.push_back(_wire.front().second);
+			else
+				rx_overflows++;
+			_wire.pop_front();
+		}
+	}
+
+	//////////////////////////////////////////////////////
+	// Act on a complete command and answer it, a display takes
+	// reply_us over each command in turn
+	//
+	void _command (void) {
+		uint8_t ack = GENIE_ACK;
+		uint8_t checksum = 0;
+		uint64_t when;
+
+		if (_to == NULL)
+			return;
+		_to->addressed++;
+		if (!_to->alive)
+			return;
+
+		when = ((_to->busy > hostNow) ? _to->busy : hostNow) + reply_us;
+		_to->busy = when;
+
+		for (uint16_t i = 0; i < _n; i++)
+			checksum ^= _cmd[i];
+		if (checksum != 0) {
+			_to->naks++;
+			ack = GENIE_NAK;
+			_send(_to, &ack, 1, when);
+			return;
+		}
+
+		_to->commands.push_back(std::vector<uint8_t>(_cmd, _cmd + _n));
+
+		switch (_cmd[0]) {
+			case GENIE_READ_OBJ: {
+				uint16_t value = (_cmd[1] == GENIE_OBJ_FORM) ? _to->form : _to->values[(_cmd[1] << 8) | _cmd[2]];
+				uint8_t frame[GENIE_FRAME_SIZE] = { GENIE_REPORT_OBJ, _cmd[1], _cmd[2],
+													highByte(value), lowByte(value), 0 };
+				_send(_to, frame, GENIE_FRAME_SIZE, when);
+				return;
+			}
+
+			case GENIE_WRITE_OBJ:
+				if (_cmd[1] == GENIE_OBJ_FORM)
+					_to->form = _cmd[2];
+				else
+					_to->values[(_cmd[1] << 8) | _cmd[2]] = (_cmd[3] << 8) | _cmd[4];
+				break;
+
+			case GENIE_WRITE_CONTRAST:
+				_to->contrast = _cmd[1];
+				break;
+
+			case GENIE_WRITE_STR:
+			case GENIE_WRITE_STRU:
+				_to->strings[_cmd[1]] = std::string((const char *)&_cmd[3], _cmd[2]);
+				break;
+		}
+		_send(_to, &ack, 1, when);
+	}
+};
+
+#endif